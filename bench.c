@@ -0,0 +1,451 @@
+/*
+ * Benchmark of queue operations across input distributions and sizes.
+ *
+ * The queue code is linked without the harness, so that allocations cost what
+ * they cost in production code. For every input and size, the strings are
+ * generated once. Each repetition builds a fresh queue from them in one bulk
+ * insertion and times the operation alone. Results are written as CSV or JSON
+ * with mean, standard deviation and a 95% confidence interval of the mean.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+#include "random.h"
+#include "shuffle.h"
+
+/* Lengths of the strings of the inputs other than long */
+#define MIN_STRLEN 5
+#define MAX_STRLEN 10
+
+/* Strings of the long input share a prefix, so comparing them scans it */
+#define LONG_STRLEN 64
+#define LONG_PREFIX 56
+
+/* Distinct strings of the few-unique input */
+#define FEW_UNIQUE 16
+
+/* Group size of the reverseK operation */
+#define REVERSE_K 16
+
+static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+
+typedef struct {
+    char **sv;  /* The n strings, in insertion order */
+    char *buf;  /* Storage of the strings */
+    int n;
+} input_t;
+
+typedef enum {
+    INPUT_RANDOM,
+    INPUT_SORTED,
+    INPUT_REVERSED,
+    INPUT_EQUAL,
+    INPUT_FEW_UNIQUE,
+    INPUT_LONG,
+    INPUT_NUM
+} input_kind_t;
+
+static const char *input_names[INPUT_NUM] = {
+    [INPUT_RANDOM] = "random",     [INPUT_SORTED] = "sorted",
+    [INPUT_REVERSED] = "reversed", [INPUT_EQUAL] = "equal",
+    [INPUT_FEW_UNIQUE] = "few-unique", [INPUT_LONG] = "long",
+};
+
+static void op_sort(struct list_head *head)
+{
+    q_sort(head);
+}
+
+static void op_delete_dup(struct list_head *head)
+{
+    q_delete_dup(head);
+}
+
+static void op_delete_mid(struct list_head *head)
+{
+    q_delete_mid(head);
+}
+
+/*
+ * The count-then-walk q_delete_mid replaced by the two cursors, kept as its
+ * baseline: count the nodes, then walk from the head to the middle. The
+ * middle node is moved to the head and removed there, which keeps the cached
+ * count right.
+ */
+static void op_delete_mid_walk(struct list_head *head)
+{
+    int n = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        n++;
+    if (!n)
+        return;
+    node = head->next;
+    for (int i = 0; i < n / 2; i++)
+        node = node->next;
+    list_move(node, head);
+    q_release_element(q_remove_head(head, NULL, 0));
+}
+
+static void op_reverse_k(struct list_head *head)
+{
+    q_reverseK(head, REVERSE_K);
+}
+
+static void op_shuffle(struct list_head *head)
+{
+    q_shuffle(head);
+}
+
+static const struct {
+    const char *name;
+    void (*op)(struct list_head *head);
+} ops[] = {
+    {"sort", op_sort},
+    {"reverse", q_reverse},
+    {"swap", q_swap},
+    {"reverseK", op_reverse_k},
+    {"delete_dup", op_delete_dup},
+    {"delete_mid", op_delete_mid},
+    {"delete_mid_walk", op_delete_mid_walk},
+    {"shuffle", op_shuffle},
+};
+
+#define OPS_NUM (sizeof(ops) / sizeof(ops[0]))
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Fill s with a random string of min to max characters, plus terminator */
+static void random_string(char *s, size_t min, size_t max)
+{
+    size_t len = min + prng_below(max - min + 1);
+    randomchars(s, len, charset, sizeof(charset) - 1);
+    s[len] = '\0';
+}
+
+static bool input_make(input_t *in, input_kind_t kind, int n)
+{
+    size_t slot = (kind == INPUT_LONG ? LONG_STRLEN : MAX_STRLEN) + 1;
+    in->n = n;
+    in->sv = malloc(n * sizeof(char *));
+    in->buf = malloc(n * slot);
+    if (!in->sv || !in->buf) {
+        free(in->sv);
+        free(in->buf);
+        return false;
+    }
+
+    char few[FEW_UNIQUE][MAX_STRLEN + 1];
+    for (int i = 0; i < FEW_UNIQUE; i++)
+        random_string(few[i], MIN_STRLEN, MAX_STRLEN);
+
+    for (int i = 0; i < n; i++) {
+        char *s = in->buf + (size_t) i * slot;
+        switch (kind) {
+        case INPUT_EQUAL:
+            memcpy(s, few[0], sizeof(few[0]));
+            break;
+        case INPUT_FEW_UNIQUE:
+            memcpy(s, few[prng_below(FEW_UNIQUE)], sizeof(few[0]));
+            break;
+        case INPUT_LONG:
+            memset(s, 'a', LONG_PREFIX);
+            random_string(s + LONG_PREFIX, LONG_STRLEN - LONG_PREFIX,
+                          LONG_STRLEN - LONG_PREFIX);
+            break;
+        default:
+            random_string(s, MIN_STRLEN, MAX_STRLEN);
+            break;
+        }
+        in->sv[i] = s;
+    }
+
+    if (kind == INPUT_SORTED || kind == INPUT_REVERSED)
+        qsort(in->sv, n, sizeof(char *), cmp_str);
+    if (kind == INPUT_REVERSED) {
+        for (int i = 0, j = n - 1; i < j; i++, j--) {
+            char *s = in->sv[i];
+            in->sv[i] = in->sv[j];
+            in->sv[j] = s;
+        }
+    }
+    return true;
+}
+
+static void input_free(input_t *in)
+{
+    free(in->sv);
+    free(in->buf);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Nanoseconds op takes on a queue holding the strings of in, -1 on failure */
+static double time_op(void (*op)(struct list_head *head), const input_t *in)
+{
+    struct list_head *q = q_new();
+    if (!q || !q_insert_tail_bulk(q, in->sv, in->n, in->n)) {
+        q_free(q);
+        return -1;
+    }
+    double start = now_ns();
+    op(q);
+    double t = now_ns() - start;
+    q_free(q);
+    return t;
+}
+
+/* Two-sided 97.5% quantiles of Student's t distribution, by degrees */
+static const double t_quantiles[] = {
+    0,     12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+    2.228, 2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+    2.086, 2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+    2.042,
+};
+
+#define T_QUANTILES (sizeof(t_quantiles) / sizeof(t_quantiles[0]))
+
+typedef struct {
+    double mean, stddev, ci95, min, max;
+} summary_t;
+
+static summary_t summarize(const double *t, int reps)
+{
+    summary_t s = {.min = t[0], .max = t[0]};
+    for (int i = 0; i < reps; i++) {
+        s.mean += t[i];
+        if (t[i] < s.min)
+            s.min = t[i];
+        if (t[i] > s.max)
+            s.max = t[i];
+    }
+    s.mean /= reps;
+    if (reps < 2)
+        return s;
+    double ss = 0;
+    for (int i = 0; i < reps; i++)
+        ss += (t[i] - s.mean) * (t[i] - s.mean);
+    s.stddev = sqrt(ss / (reps - 1));
+    int df = reps - 1;
+    double q = df < T_QUANTILES ? t_quantiles[df] : 1.960;
+    s.ci95 = q * s.stddev / sqrt(reps);
+    return s;
+}
+
+typedef enum { FORMAT_CSV, FORMAT_JSON } format_t;
+
+static void emit(FILE *out,
+                 format_t format,
+                 const char *tag,
+                 const char *op,
+                 const char *input,
+                 int size,
+                 int reps,
+                 const summary_t *s,
+                 bool first)
+{
+    if (format == FORMAT_CSV) {
+        fprintf(out, "%s,%s,%s,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.3f\n", tag, op,
+                input, size, reps, s->mean, s->stddev, s->ci95, s->min, s->max,
+                s->mean / size);
+        return;
+    }
+    fprintf(out,
+            "%s    {\"op\": \"%s\", \"input\": \"%s\", \"size\": %d, "
+            "\"reps\": %d, \"mean_ns\": %.0f, \"stddev_ns\": %.0f, "
+            "\"ci95_ns\": %.0f, \"min_ns\": %.0f, \"max_ns\": %.0f, "
+            "\"ns_per_element\": %.3f}",
+            first ? "" : ",\n", op, input, size, reps, s->mean, s->stddev,
+            s->ci95, s->min, s->max, s->mean / size);
+}
+
+static void usage(const char *cmd)
+{
+    printf("Usage: %s [-h] [-f FORMAT] [-o FILE] [-r REPS] [-m MIN] [-n MAX]\n"
+           "       [-i INPUT] [-p OP] [-s SEED] [-t TAG]\n",
+           cmd);
+    printf("\t-h         Print this information\n");
+    printf("\t-f FORMAT  Write results as csv or json (default: csv)\n");
+    printf("\t-o FILE    Write results to FILE (default: standard output)\n");
+    printf("\t-r REPS    Repetitions of each measurement (default: 5)\n");
+    printf("\t-m MIN     Smallest queue size (default: 1000)\n");
+    printf("\t-n MAX     Largest queue size, sizes grow tenfold "
+           "(default: 10000000)\n");
+    printf("\t-i INPUT   Only measure input INPUT, may be repeated\n");
+    printf("\t-p OP      Only measure operation OP, may be repeated\n");
+    printf("\t-s SEED    Seed of the generated inputs (default: 1)\n");
+    printf("\t-t TAG     Label of the results, such as a commit "
+           "(default: none)\n");
+    printf("Inputs:");
+    for (int i = 0; i < INPUT_NUM; i++)
+        printf(" %s", input_names[i]);
+    printf("\nOperations:");
+    for (size_t i = 0; i < OPS_NUM; i++)
+        printf(" %s", ops[i].name);
+    printf("\n");
+}
+
+/* Index of name in names, or -1 */
+static int lookup(const char *name, const char *const *names, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (!strcmp(name, names[i]))
+            return i;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    format_t format = FORMAT_CSV;
+    const char *outfile = NULL, *tag = "";
+    int reps = 5, min_size = 1000, max_size = 10000000;
+    unsigned long seed = 1;
+    bool input_on[INPUT_NUM] = {false}, inputs_given = false;
+    bool op_on[OPS_NUM] = {false}, ops_given = false;
+    const char *op_names[OPS_NUM];
+    for (size_t i = 0; i < OPS_NUM; i++)
+        op_names[i] = ops[i].name;
+
+    int c;
+    while ((c = getopt(argc, argv, "hf:o:r:m:n:i:p:s:t:")) != -1) {
+        int k;
+        switch (c) {
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        case 'f':
+            if (!strcmp(optarg, "csv")) {
+                format = FORMAT_CSV;
+            } else if (!strcmp(optarg, "json")) {
+                format = FORMAT_JSON;
+            } else {
+                fprintf(stderr, "Unknown format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'm':
+            min_size = atoi(optarg);
+            break;
+        case 'n':
+            max_size = atoi(optarg);
+            break;
+        case 'i':
+            k = lookup(optarg, input_names, INPUT_NUM);
+            if (k < 0) {
+                fprintf(stderr, "Unknown input '%s'\n", optarg);
+                return 1;
+            }
+            input_on[k] = inputs_given = true;
+            break;
+        case 'p':
+            k = lookup(optarg, op_names, OPS_NUM);
+            if (k < 0) {
+                fprintf(stderr, "Unknown operation '%s'\n", optarg);
+                return 1;
+            }
+            op_on[k] = ops_given = true;
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            tag = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1 || min_size < 1 || max_size < min_size) {
+        fprintf(stderr, "Need REPS >= 1 and 1 <= MIN <= MAX\n");
+        return 1;
+    }
+
+    FILE *out = outfile ? fopen(outfile, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Could not open %s: %s\n", outfile, strerror(errno));
+        return 1;
+    }
+    double *t = malloc(reps * sizeof(double));
+    if (!t) {
+        fprintf(stderr, "Could not allocate %d repetitions\n", reps);
+        return 1;
+    }
+
+    if (format == FORMAT_CSV)
+        fprintf(out, "tag,op,input,size,reps,mean_ns,stddev_ns,ci95_ns,"
+                     "min_ns,max_ns,ns_per_element\n");
+    else
+        fprintf(out, "{\n  \"tag\": \"%s\",\n  \"results\": [\n", tag);
+
+    bool ok = true, first = true;
+    for (int k = 0; k < INPUT_NUM; k++) {
+        if (inputs_given && !input_on[k])
+            continue;
+        for (long size = min_size; size <= max_size; size *= 10) {
+            /* The same strings for every operation of this size */
+            prng_seed(seed + k * 1000003 + size);
+            input_t in;
+            if (!input_make(&in, k, size)) {
+                fprintf(stderr, "Could not allocate %s input of %ld\n",
+                        input_names[k], size);
+                ok = false;
+                break;
+            }
+            for (size_t o = 0; o < OPS_NUM; o++) {
+                if (ops_given && !op_on[o])
+                    continue;
+                fprintf(stderr, "%s %s %ld\n", ops[o].name, input_names[k],
+                        size);
+                int r;
+                for (r = 0; r < reps; r++) {
+                    t[r] = time_op(ops[o].op, &in);
+                    if (t[r] < 0)
+                        break;
+                }
+                if (r < reps) {
+                    fprintf(stderr, "Could not build a queue of %ld\n", size);
+                    ok = false;
+                    continue;
+                }
+                summary_t s = summarize(t, reps);
+                emit(out, format, tag, ops[o].name, input_names[k], size, reps,
+                     &s, first);
+                first = false;
+                fflush(out);
+            }
+            input_free(&in);
+        }
+    }
+
+    if (format == FORMAT_JSON)
+        fprintf(out, "%s  ]\n}\n", first ? "" : "\n");
+    free(t);
+    if (out != stdout)
+        ok = !fclose(out) && ok;
+    return ok ? 0 : 1;
+}
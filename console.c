@@ -10,17 +10,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "perf.h"
 #include "report.h"
 
 /* Some global values */
 int simulation = 0;
 static cmd_ptr cmd_list = NULL;
 static param_ptr param_list = NULL;
+
+/* Hash tables of commands and parameters, keyed by name */
+#define NAME_HASH_SIZE 64
+static cmd_ptr cmd_table[NAME_HASH_SIZE];
+static param_ptr param_table[NAME_HASH_SIZE];
 static bool block_flag = false;
 static bool prompt_flag = true;
 
@@ -34,6 +41,7 @@ static double last_time;
 /*
  * Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
+ * Regular files are mapped instead, and their lines handed out in place.
  */
 
 #define RIO_BUFSIZE 8192
@@ -44,12 +52,22 @@ struct RIO_ELE {
     int cnt;               /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Private mapping of file, or NULL */
+    size_t map_len;        /* Length of mapping */
+    size_t map_pos;        /* Offset of next unread byte in mapping */
     rio_ptr prev;          /* Next element in stack */
 };
 
 static rio_ptr buf_stack;
 static char linebuf[RIO_BUFSIZE];
 
+/*
+ * Reusable argument vector. Every word but the last is followed by a
+ * separator, so a line that fits in linebuf cannot hold more words.
+ */
+#define MAXARGS (RIO_BUFSIZE / 2)
+static char *argv_buf[MAXARGS];
+
 /* Maximum file descriptor */
 static int fd_max = 0;
 
@@ -69,6 +87,9 @@ static bool has_infile = false;
 static cmd_function quit_helpers[MAXQUIT];
 static int quit_helper_cnt = 0;
 
+/* Optional function to call after every command */
+static cmd_function post_cmd_hook = NULL;
+
 static void init_in();
 
 static bool push_file(char *fname);
@@ -76,6 +97,39 @@ static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
 
+/* FNV-1a hash of string */
+static uint32_t fnv_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Hash of name, reduced to a table index */
+static unsigned int name_hash(const char *name)
+{
+    return fnv_hash(name) & (NAME_HASH_SIZE - 1);
+}
+
+static cmd_ptr find_cmd(const char *name)
+{
+    cmd_ptr c = cmd_table[name_hash(name)];
+    while (c && strcmp(name, c->name) != 0)
+        c = c->hash_next;
+    return c;
+}
+
+static param_ptr find_param(const char *name)
+{
+    param_ptr p = param_table[name_hash(name)];
+    while (p && strcmp(name, p->name) != 0)
+        p = p->hash_next;
+    return p;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_function operation, char *documentation)
 {
@@ -92,6 +146,10 @@ void add_cmd(char *name, cmd_function operation, char *documentation)
     ele->documentation = documentation;
     ele->next = next_cmd;
     *last_loc = ele;
+
+    cmd_ptr *bucket = &cmd_table[name_hash(name)];
+    ele->hash_next = *bucket;
+    *bucket = ele;
 }
 
 /* Add a new parameter */
@@ -114,52 +172,40 @@ void add_param(char *name,
     ele->setter = setter;
     ele->next = next_param;
     *last_loc = ele;
+
+    param_ptr *bucket = &param_table[name_hash(name)];
+    ele->hash_next = *bucket;
+    *bucket = ele;
 }
 
-/* Parse a string into a command line */
+/*
+ * Split a command line into words in place, by null-terminating each word.
+ * The returned vector is reused by the next call, so no heap allocation is
+ * needed. Return NULL if there are more than MAXARGS words.
+ */
 static char **parse_args(char *line, int *argcp)
 {
-    /*
-     * Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
     char *src = line;
-    char *dst = buf;
-    bool skipping = true;
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
-        if (isspace(c)) {
-            if (!skipping) {
-                /* Hit end of word */
-                *dst++ = '\0';
-                skipping = true;
-            }
-        } else {
-            if (skipping) {
-                /* Hit start of new word */
-                argc++;
-                skipping = false;
-            }
-            *dst++ = c;
-        }
-    }
-
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
+    while (true) {
+        while (isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
+        if (argc == MAXARGS)
+            return NULL;
+        /* Hit start of new word */
+        argv_buf[argc++] = src;
+        while (*src != '\0' && !isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
+        /* Hit end of word */
+        *src++ = '\0';
     }
 
-    free_block(buf, len + 1);
     *argcp = argc;
-    return argv;
+    return argv_buf;
 }
 
 static void record_error()
@@ -171,20 +217,16 @@ static void record_error()
     }
 }
 
-/* Execute a command that has already been split into arguments */
-static bool interpret_cmda(int argc, char *argv[])
+/* Execute command next_cmd, or report that argv[0] is unknown if NULL */
+static bool run_cmd(cmd_ptr next_cmd, int argc, char *argv[])
 {
-    if (argc == 0)
-        return true;
-    /* Try to find matching command */
-    cmd_ptr next_cmd = cmd_list;
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
         ok = next_cmd->operation(argc, argv);
         if (!ok)
             record_error();
+        if (post_cmd_hook)
+            post_cmd_hook(argc, argv);
     } else {
         report(1, "Unknown command '%s'", argv[0]);
         record_error();
@@ -194,7 +236,16 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
-/* Execute a command from a command line */
+/* Execute a command that has already been split into arguments */
+static bool interpret_cmda(int argc, char *argv[])
+{
+    if (argc == 0)
+        return true;
+    /* Try to find matching command */
+    return run_cmd(find_cmd(argv[0]), argc, argv);
+}
+
+/* Execute a command from a command line, which is split up in place */
 static bool interpret_cmd(char *cmdline)
 {
     if (quit_flag)
@@ -205,12 +256,13 @@ static bool interpret_cmd(char *cmdline)
 #endif
     int argc;
     char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
+    if (!argv) {
+        report(1, "Too many arguments (maximum %d)", MAXARGS);
+        record_error();
+        return false;
+    }
 
-    return ok;
+    return interpret_cmda(argc, argv);
 }
 
 /* Set function to be executed as part of program exit */
@@ -222,6 +274,12 @@ void add_quit_helper(cmd_function qf)
         report_event(MSG_FATAL, "Exceeded limit on quit helpers");
 }
 
+/* Set function to be executed after every command, NULL for none */
+void set_post_cmd_hook(cmd_function hook)
+{
+    post_cmd_hook = hook;
+}
+
 /* Turn echoing on/off */
 void set_echo(bool on)
 {
@@ -245,6 +303,8 @@ static bool do_quit(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_ele));
     }
+    memset(cmd_table, 0, sizeof(cmd_table));
+    memset(param_table, 0, sizeof(param_table));
 
     while (buf_stack)
         pop_file();
@@ -317,7 +377,6 @@ static bool do_option(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         char *name = argv[i];
         int value = 0;
-        bool found = false;
         /* Get value from next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
@@ -326,20 +385,15 @@ static bool do_option(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_ptr plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
-        }
-        /* Didn't find parameter */
-        if (!found) {
+        /* Find parameter in table */
+        param_ptr plist = find_param(name);
+        if (plist) {
+            int oldval = *plist->valp;
+            *plist->valp = value;
+            if (plist->setter)
+                plist->setter(oldval);
+        } else {
+            /* Didn't find parameter */
             report(1, "Unknown parameter '%s'", name);
             return false;
         }
@@ -385,23 +439,41 @@ static bool do_time(int argc, char *argv[])
         double elapsed = last_time - first_time;
         report(1, "Elapsed time = %.3f, Delta time = %.3f", elapsed, delta);
     } else {
+        perf_counts_t counts = {.runs = 0};
+        perf_begin();
         ok = interpret_cmda(argc - 1, argv + 1);
+        perf_end(&counts);
+        if (perf_enabled)
+            perf_collect(&counts);
         if (block_flag) {
             block_timing = true;
         } else {
             delta = delta_time(&last_time);
             report(1, "Delta time = %.3f", delta);
+            if (perf_enabled)
+                perf_report(argv[1], &counts);
         }
     }
 
     return ok;
 }
 
+static void perf_changed(int oldval)
+{
+    const char *why;
+    if (perf_enabled && !perf_open(&why)) {
+        report(1, "Performance counters are unavailable: %s", why);
+        perf_enabled = 0;
+    }
+}
+
 /* Initialize interpreter */
 void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    memset(cmd_table, 0, sizeof(cmd_table));
+    memset(param_table, 0, sizeof(param_table));
     err_cnt = 0;
     quit_flag = false;
 
@@ -416,6 +488,10 @@ void init_cmd()
     add_param("verbose", &verblevel, "Verbosity level", NULL);
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
+    add_param("perf", &perf_enabled,
+              "Count hardware events of commands under time and of "
+              "simulation mode",
+              perf_changed);
 
     init_in();
     init_time(&last_time);
@@ -440,9 +516,28 @@ static bool push_file(char *fname)
     rnew->fd = fd;
     rnew->cnt = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_len = 0;
+    rnew->map_pos = 0;
     rnew->prev = buf_stack;
     buf_stack = rnew;
 
+    /*
+     * Map regular files privately, so that lines can be split up in place.
+     * Fall back to reading them if they cannot be mapped.
+     */
+    struct stat st;
+    if (fname && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            rnew->map = map;
+            rnew->map_len = st.st_size;
+        }
+    }
+
     return true;
 }
 
@@ -452,6 +547,8 @@ static void pop_file()
     if (buf_stack) {
         rio_ptr rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_len);
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -463,6 +560,41 @@ static void init_in()
     buf_stack = NULL;
 }
 
+/* Read command from mapped input file, in place where possible */
+static char *readline_mapped()
+{
+    rio_ptr r = buf_stack;
+    if (r->map_pos == r->map_len) {
+        /* Encountered EOF */
+        pop_file();
+        return NULL;
+    }
+
+    char *line = r->map + r->map_pos;
+    size_t left = r->map_len - r->map_pos;
+    /* Split lines at the same length as the buffered path */
+    size_t max = left < RIO_BUFSIZE - 2 ? left : RIO_BUFSIZE - 2;
+    char *nl = memchr(line, '\n', max);
+    if (nl) {
+        /* Terminate line in place, dropping its newline */
+        *nl = '\0';
+        r->map_pos += nl - line + 1;
+    } else {
+        /* Unterminated or overlong line.  Copy it, as there is no room */
+        memcpy(linebuf, line, max);
+        linebuf[max] = '\0';
+        r->map_pos += max;
+        line = linebuf;
+    }
+
+    if (echo) {
+        report_noreturn(1, prompt);
+        report(1, "%s", line);
+    }
+
+    return line;
+}
+
 /* Read command from input file.
  * When hit EOF, close that file and return NULL
  */
@@ -474,6 +606,8 @@ static char *readline()
 
     if (!buf_stack)
         return NULL;
+    if (buf_stack->map)
+        return readline_mapped();
 
     for (cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
         if (buf_stack->cnt <= 0) {
@@ -547,6 +681,14 @@ int cmd_select(int nfds,
     if (cmd_done())
         return 0;
 
+    if (!block_flag && nfds == 0 && buf_stack->map) {
+        /* A mapped file is always readable, so there is nothing to wait for */
+        char *cmdline = readline();
+        if (cmdline)
+            interpret_cmd(cmdline);
+        return 0;
+    }
+
     if (!block_flag) {
         /* Process any commands in input buffer */
         if (!readfds)
@@ -636,8 +778,352 @@ void completion(const char *buf, linenoiseCompletions *lc)
     }
 }
 
+/*
+ * Binary traces hold the commands of a text trace as a sequence of records
+ * over a table of interned strings, so that replaying them needs no reading
+ * or splitting of lines and no lookup of commands by name. The header holds
+ * 32-bit integers in host byte order. The layout is
+ *
+ *   header                 magic "QTB1", string count, pool bytes and
+ *                          record bytes
+ *   string pool            every distinct word and line, null-terminated, in
+ *                          order of first appearance
+ *   records                repeat count, id of the line as written, argc,
+ *                          then argc string ids, of which the first names the
+ *                          command, each encoded as a little-endian base 128
+ *                          varint
+ *
+ * Identical consecutive lines are folded into one record. Lines are kept as
+ * written, blank ones included, so that replay echoes them byte for byte like
+ * the text path does.
+ */
+#define TRACE_MAGIC "QTB1"
+
+typedef struct {
+    char magic[4];
+    uint32_t nstrings;
+    uint32_t pool_bytes;
+    uint32_t code_bytes;
+} trace_header_t;
+
+/* Strings and records of a trace being compiled */
+typedef struct {
+    char *pool;
+    size_t pool_len, pool_cap;
+    uint32_t *offsets; /* Start of each string in pool */
+    uint32_t nstrings, strings_cap;
+    uint32_t *slots; /* Open addressing table of string id + 1, or 0 */
+    uint32_t slots_cap;
+    unsigned char *code;
+    size_t code_len, code_cap;
+    /* Last command, not yet written to code */
+    uint32_t repeat;
+    uint32_t line;
+    int argc;
+    uint32_t ids[MAXARGS];
+} trace_builder_t;
+
+/* Enlarge block b of old_bytes to new_bytes */
+static void *grow_block(void *b, size_t old_bytes, size_t new_bytes)
+{
+    void *n = malloc_or_fail(new_bytes, "grow_block");
+    if (b) {
+        memcpy(n, b, old_bytes);
+        free_block(b, old_bytes);
+    }
+    return n;
+}
+
+static void trace_emit(trace_builder_t *tb, uint32_t v)
+{
+    /* A 32-bit value takes at most 5 bytes */
+    if (tb->code_len + 5 > tb->code_cap) {
+        size_t cap = tb->code_cap ? 2 * tb->code_cap : 4096;
+        tb->code = grow_block(tb->code, tb->code_cap, cap);
+        tb->code_cap = cap;
+    }
+    while (v >= 0x80) {
+        tb->code[tb->code_len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    tb->code[tb->code_len++] = v;
+}
+
+static void trace_rehash(trace_builder_t *tb, uint32_t cap)
+{
+    if (tb->slots)
+        free_array(tb->slots, tb->slots_cap, sizeof(uint32_t));
+    tb->slots = calloc_or_fail(cap, sizeof(uint32_t), "trace_rehash");
+    tb->slots_cap = cap;
+    for (uint32_t id = 0; id < tb->nstrings; id++) {
+        uint32_t i = fnv_hash(tb->pool + tb->offsets[id]) & (cap - 1);
+        while (tb->slots[i])
+            i = (i + 1) & (cap - 1);
+        tb->slots[i] = id + 1;
+    }
+}
+
+/* Return id of string s, adding it to the pool if it is new */
+static uint32_t trace_intern(trace_builder_t *tb, const char *s)
+{
+    if (2 * (tb->nstrings + 1) > tb->slots_cap)
+        trace_rehash(tb, tb->slots_cap ? 2 * tb->slots_cap : 256);
+
+    uint32_t mask = tb->slots_cap - 1;
+    uint32_t i = fnv_hash(s) & mask;
+    for (; tb->slots[i]; i = (i + 1) & mask) {
+        uint32_t id = tb->slots[i] - 1;
+        if (strcmp(tb->pool + tb->offsets[id], s) == 0)
+            return id;
+    }
+
+    size_t len = strlen(s) + 1;
+    if (tb->pool_len + len > tb->pool_cap) {
+        size_t cap = tb->pool_cap ? 2 * tb->pool_cap : 4096;
+        while (cap < tb->pool_len + len)
+            cap *= 2;
+        tb->pool = grow_block(tb->pool, tb->pool_cap, cap);
+        tb->pool_cap = cap;
+    }
+    if (tb->nstrings == tb->strings_cap) {
+        uint32_t cap = tb->strings_cap ? 2 * tb->strings_cap : 256;
+        tb->offsets =
+            grow_block(tb->offsets, tb->strings_cap * sizeof(uint32_t),
+                       cap * sizeof(uint32_t));
+        tb->strings_cap = cap;
+    }
+    memcpy(tb->pool + tb->pool_len, s, len);
+    tb->offsets[tb->nstrings] = tb->pool_len;
+    tb->pool_len += len;
+    tb->slots[i] = ++tb->nstrings;
+    return tb->nstrings - 1;
+}
+
+/* Write the last command to code */
+static void trace_flush(trace_builder_t *tb)
+{
+    if (!tb->repeat)
+        return;
+    trace_emit(tb, tb->repeat);
+    trace_emit(tb, tb->line);
+    trace_emit(tb, tb->argc);
+    for (int i = 0; i < tb->argc; i++)
+        trace_emit(tb, tb->ids[i]);
+    tb->repeat = 0;
+}
+
+/*
+ * Add line, split into argv, or count it again if it repeats the last one.
+ * Equal lines split into equal words, so comparing the lines is enough.
+ */
+static void trace_add_cmd(trace_builder_t *tb,
+                          uint32_t line,
+                          int argc,
+                          char *argv[])
+{
+    if (tb->repeat && tb->repeat < UINT32_MAX && tb->line == line) {
+        tb->repeat++;
+        return;
+    }
+
+    trace_flush(tb);
+    tb->repeat = 1;
+    tb->line = line;
+    tb->argc = argc;
+    for (int i = 0; i < argc; i++)
+        tb->ids[i] = trace_intern(tb, argv[i]);
+}
+
+bool compile_trace(char *infile_name, char *outfile_name)
+{
+    if (!push_file(infile_name)) {
+        report(1, "ERROR: Could not open source file '%s'", infile_name);
+        return false;
+    }
+
+    /* Compile with the same line reading and splitting as run_console */
+    int old_echo = echo;
+    echo = 0;
+    trace_builder_t *tb = calloc_or_fail(1, sizeof(*tb), "compile_trace");
+    char *cmdline;
+    bool ok = true;
+    while (ok && (cmdline = readline()) != NULL) {
+        /* Keep the line as echoed, without the newline readline may leave */
+        size_t len = strlen(cmdline);
+        if (len && cmdline[len - 1] == '\n')
+            cmdline[len - 1] = '\0';
+        uint32_t line = trace_intern(tb, cmdline);
+
+        int argc;
+        char **argv = parse_args(cmdline, &argc);
+        if (!argv) {
+            report(1, "ERROR: Too many arguments (maximum %d)", MAXARGS);
+            ok = false;
+        } else
+            trace_add_cmd(tb, line, argc, argv);
+    }
+    trace_flush(tb);
+    echo = old_echo;
+    while (buf_stack)
+        pop_file();
+
+    FILE *fp = ok ? fopen(outfile_name, "wb") : NULL;
+    if (ok && !fp) {
+        report(1, "ERROR: Could not open output file '%s'", outfile_name);
+        ok = false;
+    }
+    if (fp) {
+        trace_header_t header = {.nstrings = tb->nstrings,
+                                 .pool_bytes = tb->pool_len,
+                                 .code_bytes = tb->code_len};
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(tb->pool, 1, tb->pool_len, fp) == tb->pool_len &&
+             fwrite(tb->code, 1, tb->code_len, fp) == tb->code_len;
+        ok = fclose(fp) == 0 && ok;
+        if (!ok)
+            report(1, "ERROR: Could not write output file '%s'", outfile_name);
+    }
+
+    if (tb->pool)
+        free_block(tb->pool, tb->pool_cap);
+    if (tb->offsets)
+        free_array(tb->offsets, tb->strings_cap, sizeof(uint32_t));
+    if (tb->slots)
+        free_array(tb->slots, tb->slots_cap, sizeof(uint32_t));
+    if (tb->code)
+        free_block(tb->code, tb->code_cap);
+    free_block(tb, sizeof(*tb));
+    return ok;
+}
+
+/* Decode a varint at *pp, which must lie before end */
+static bool trace_read(const unsigned char **pp,
+                       const unsigned char *end,
+                       uint32_t *v)
+{
+    uint32_t x = 0;
+    for (int shift = 0; *pp < end && shift < 32; shift += 7) {
+        unsigned char c = *(*pp)++;
+        x |= (uint32_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = x;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Run the records of a binary trace held in buf */
+static bool replay_trace(char *buf, size_t bytes)
+{
+    trace_header_t header;
+    memcpy(&header, buf, sizeof(header));
+    /* Every string takes at least its null byte */
+    if (bytes != sizeof(header) + (size_t) header.pool_bytes +
+                     header.code_bytes ||
+        header.nstrings > header.pool_bytes)
+        return false;
+    char *pool = buf + sizeof(header);
+    const unsigned char *code =
+        (const unsigned char *) (pool + header.pool_bytes);
+    const unsigned char *end = code + header.code_bytes;
+    if (header.pool_bytes && pool[header.pool_bytes - 1] != '\0')
+        return false;
+
+    /* Resolve every string once, including the commands they may name */
+    size_t nslots = (size_t) header.nstrings + 1;
+    char **strs = calloc_or_fail(nslots, sizeof(char *), "replay_trace");
+    cmd_ptr *ops = calloc_or_fail(nslots, sizeof(cmd_ptr), "replay_trace");
+    uint32_t n = 0;
+    for (char *s = pool; s < pool + header.pool_bytes && n < header.nstrings;
+         s += strlen(s) + 1) {
+        strs[n] = s;
+        ops[n++] = find_cmd(s);
+    }
+
+    bool ok = n == header.nstrings;
+    while (ok && code < end && !quit_flag) {
+        uint32_t repeat, line, argc, id, op_id = 0;
+        ok = trace_read(&code, end, &repeat) && trace_read(&code, end, &line) &&
+             line < n && trace_read(&code, end, &argc) && argc <= MAXARGS;
+        for (uint32_t i = 0; ok && i < argc; i++) {
+            ok = trace_read(&code, end, &id) && id < n;
+            if (ok)
+                argv_buf[i] = strs[id];
+            if (i == 0)
+                op_id = id;
+        }
+        if (!ok)
+            break;
+        cmd_ptr op = ops[op_id];
+
+        for (uint32_t r = 0; r < repeat && !quit_flag; r++) {
+            /* Echo the line the way readline does */
+            if (echo) {
+                report_noreturn(1, "%s", prompt);
+                report(1, "%s", strs[line]);
+            }
+            if (argc)
+                run_cmd(op, argc, argv_buf);
+            /* Commands read by source still come through readline */
+            while (!cmd_done())
+                cmd_select(0, NULL, NULL, NULL, NULL);
+        }
+    }
+
+    free_array(strs, nslots, sizeof(char *));
+    free_array(ops, nslots, sizeof(cmd_ptr));
+    return ok;
+}
+
+/*
+ * Replay infile_name if it is a binary trace. Return false if it is not one,
+ * otherwise set *okp to false if it is malformed.
+ */
+static bool try_binary_trace(char *infile_name, bool *okp)
+{
+    int fd = open(infile_name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 ||
+        (size_t) st.st_size < sizeof(trace_header_t)) {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    char magic[4];
+    if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t bytes = st.st_size;
+    char *buf = malloc_or_fail(bytes, "try_binary_trace");
+    memcpy(buf, magic, sizeof(magic));
+    size_t got = sizeof(magic);
+    while (got < bytes) {
+        ssize_t r = read(fd, buf + got, bytes - got);
+        if (r <= 0)
+            break;
+        got += r;
+    }
+    close(fd);
+
+    *okp = got == bytes && replay_trace(buf, bytes);
+    if (!*okp)
+        report(1, "ERROR: Malformed binary trace '%s'", infile_name);
+    free_block(buf, bytes);
+    return true;
+}
+
 bool run_console(char *infile_name)
 {
+    bool ok = true;
+    if (infile_name && try_binary_trace(infile_name, &ok))
+        return ok && err_cnt == 0;
+
     if (!push_file(infile_name)) {
         report(1, "ERROR: Could not open source file '%s'", infile_name);
         return false;
@@ -646,8 +1132,9 @@ bool run_console(char *infile_name)
     if (!has_infile) {
         char *cmdline;
         while ((cmdline = linenoise(prompt)) != NULL) {
+            /* Add to the history before the line is split up */
+            linenoiseHistoryAdd(cmdline);
             interpret_cmd(cmdline);
-            linenoiseHistoryAdd(cmdline);       /* Add to the history. */
             linenoiseHistorySave(HISTORY_FILE); /* Save the history on disk. */
             linenoiseFree(cmdline);
         }
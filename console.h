@@ -15,13 +15,17 @@ typedef bool (*cmd_function)(int argc, char *argv[]);
 
 /* Information about each command */
 
-/* Organized as linked list in alphabetical order */
+/*
+ * Organized as linked list in alphabetical order, and chained into a hash
+ * table for lookup by name
+ */
 typedef struct CELE cmd_ele, *cmd_ptr;
 struct CELE {
     char *name;
     cmd_function operation;
     char *documentation;
     cmd_ptr next;
+    cmd_ptr hash_next;
 };
 
 /* Optionally supply function that gets invoked when parameter changes */
@@ -36,6 +40,7 @@ struct PELE {
     /* Function that gets called whenever parameter changes */
     setter_function setter;
     param_ptr next;
+    param_ptr hash_next;
 };
 
 /* Initialize interpreter */
@@ -57,6 +62,9 @@ bool get_int(char *vname, int *loc);
 /* Add function to be executed as part of program exit */
 void add_quit_helper(cmd_function qf);
 
+/* Set function to be executed after every command, NULL for none */
+void set_post_cmd_hook(cmd_function hook);
+
 /* Turn echoing on/off */
 void set_echo(bool on);
 
@@ -75,10 +83,16 @@ int cmd_select(int nfds,
                fd_set *exceptfds,
                struct timeval *timeout);
 
-/* Run command loop.  Non-null infile_name implies read commands from that file
+/* Run command loop.  Non-null infile_name implies read commands from that file,
+ * which may be a binary trace made by compile_trace
  */
 bool run_console(char *infile_name);
 
+/* Compile commands of text file infile_name into binary trace outfile_name.
+ * Return true if successful.
+ */
+bool compile_trace(char *infile_name, char *outfile_name);
+
 /* Callback function to complete command by linenoise */
 void completion(const char *buf, linenoiseCompletions *lc);
 
@@ -0,0 +1,199 @@
+/** Empirical complexity of queue operations.
+ *
+ * For every queue size in a geometric range, a fresh queue is filled, the
+ * operation under test is timed in CPU cycles, and the median of a few runs
+ * is kept. Each candidate model f is fitted as t(n) = c * f(n) by least
+ * squares on the relative error, so that small and large sizes weigh alike,
+ * and the model with the smallest residual is reported as the best fit.
+ *
+ * The sizes only span a factor of 8. Smaller queues stay in cache, which makes
+ * linear operations look superlinear from 1024 elements up. Over so narrow a
+ * range N and N log N fit each other's timings within noise, and a sort fits
+ * N log N with a residual of 0.2 to 0.3 already. Thus an operation passes if
+ * the expected model fits nearly as well as the best one. This catches
+ * quadratic growth, but growth in between, such as N^1.5, is not reliably
+ * told apart from N log N: no model lies between the two, so it may pass.
+ */
+
+#include "complexity.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../random.h"
+#include "constant.h"
+#include "cpucycles.h"
+
+/* Queue sizes are min_size, 2 * min_size, ..., min_size << (n_sizes - 1) */
+#define min_size 32768
+#define n_sizes 4
+#define n_runs 3
+
+/* How much worse than the best fit the expected model may fit */
+#define rms_tolerance 0.1
+
+static const char *model_names[COMPLEXITY_NUM] = {
+    [COMPLEXITY_1] = "O(1)",
+    [COMPLEXITY_LOG_N] = "O(log N)",
+    [COMPLEXITY_N] = "O(N)",
+    [COMPLEXITY_N_LOG_N] = "O(N log N)",
+    [COMPLEXITY_N2] = "O(N^2)",
+};
+
+static double model(complexity_t m, double n)
+{
+    switch (m) {
+    case COMPLEXITY_1:
+        return 1;
+    case COMPLEXITY_LOG_N:
+        return log2(n);
+    case COMPLEXITY_N:
+        return n;
+    case COMPLEXITY_N_LOG_N:
+        return n * log2(n);
+    default:
+        return n * n;
+    }
+}
+
+/* xorshift64, seeded once from randombytes; filling must stay cheap */
+static uint64_t next_random(void)
+{
+    static uint64_t x = 0;
+    while (!x)
+        randombytes((uint8_t *) &x, sizeof(x));
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+/* Fill queue with n strings, sorted and with runs of duplicates if asked */
+static bool fill(struct list_head *q, int n, bool sorted)
+{
+    char s[16];
+    for (int i = 0; i < n; i++) {
+        if (sorted) {
+            /* Fixed width, so that lexical order follows numerical order */
+            snprintf(s, sizeof(s), "%08d", i / 4);
+        } else {
+            uint64_t r = next_random();
+            for (int j = 0; j < 8; j++, r >>= 8)
+                s[j] = 'a' + (r & 0xff) % 26;
+            s[8] = '\0';
+        }
+        if (!q_insert_tail(q, s))
+            return false;
+    }
+    return true;
+}
+
+static int cmp_cycles(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Median cycles op takes on a queue of n elements, negative on failure */
+static double time_op(void (*op)(struct list_head *head),
+                      int n,
+                      bool sorted,
+                      perf_counts_t *perf)
+{
+    int64_t cycles[n_runs];
+    for (int r = 0; r < n_runs; r++) {
+        struct list_head *q = dut_queue();
+        if (!q || !fill(q, n, sorted)) {
+            q_free(q);
+            return -1;
+        }
+        perf_begin();
+        int64_t before = cpucycles();
+        op(q);
+        cycles[r] = cpucycles() - before;
+        perf_end(perf);
+        q_free(q);
+    }
+    qsort(cycles, n_runs, sizeof(int64_t), cmp_cycles);
+    return cycles[n_runs / 2];
+}
+
+/* Fit t = c * f(n) and return the RMS of the relative residuals */
+static double fit(complexity_t m, const double *n, const double *t)
+{
+    double num = 0, den = 0;
+    for (int i = 0; i < n_sizes; i++) {
+        double f = model(m, n[i]) / t[i];
+        num += f;
+        den += f * f;
+    }
+    double c = num / den, rss = 0;
+    for (int i = 0; i < n_sizes; i++) {
+        double r = (t[i] - c * model(m, n[i])) / t[i];
+        rss += r * r;
+    }
+    return sqrt(rss / n_sizes);
+}
+
+static bool test_complexity(char *text,
+                            void (*op)(struct list_head *head),
+                            bool sorted,
+                            complexity_t expected)
+{
+    double n[n_sizes], t[n_sizes];
+    perf_counts_t perf[n_sizes] = {{{0}}};
+    printf("Testing %s...\n", text);
+    for (int i = 0; i < n_sizes; i++) {
+        n[i] = (double) (min_size << i);
+        t[i] = time_op(op, min_size << i, sorted, &perf[i]);
+        if (perf_enabled)
+            perf_collect(&perf[i]);
+        if (t[i] <= 0) {
+            printf("Could not time %s on %d elements\n", text, min_size << i);
+            return false;
+        }
+    }
+
+    complexity_t best = COMPLEXITY_1;
+    double rms[COMPLEXITY_NUM];
+    for (complexity_t m = COMPLEXITY_1; m < COMPLEXITY_NUM; m++) {
+        rms[m] = fit(m, n, t);
+        if (rms[m] < rms[best])
+            best = m;
+    }
+    printf("\033[A\033[2K");
+    printf("%s: best fit %s (rms %.2f), expected %s (rms %.2f)\n", text,
+           model_names[best], rms[best], model_names[expected],
+           rms[expected]);
+    for (int i = 0; perf_enabled && i < n_sizes; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s of %d", text, min_size << i);
+        perf_report(name, &perf[i]);
+    }
+    return best <= expected || rms[expected] < rms[best] + rms_tolerance;
+}
+
+bool is_sort_n_log_n(void (*sort)(struct list_head *head))
+{
+    return test_complexity("sort", sort, false, COMPLEXITY_N_LOG_N);
+}
+
+bool is_reverse_linear(void)
+{
+    return test_complexity("reverse", q_reverse, false, COMPLEXITY_N);
+}
+
+bool is_swap_linear(void)
+{
+    return test_complexity("swap", q_swap, false, COMPLEXITY_N);
+}
+
+static void op_delete_dup(struct list_head *head)
+{
+    q_delete_dup(head);
+}
+
+bool is_delete_dup_linear(void)
+{
+    return test_complexity("delete_dup", op_delete_dup, true, COMPLEXITY_N);
+}
@@ -0,0 +1,27 @@
+#ifndef DUDECT_COMPLEXITY_H
+#define DUDECT_COMPLEXITY_H
+
+#include <stdbool.h>
+#include "queue.h"
+
+/*
+ * Interface to test the growth of operations walking the whole queue.
+ * Each operation is timed over a geometric range of queue sizes, and the
+ * timings are fitted against the candidate models below. A test passes if
+ * the best fit grows no faster than expected.
+ */
+typedef enum {
+    COMPLEXITY_1,
+    COMPLEXITY_LOG_N,
+    COMPLEXITY_N,
+    COMPLEXITY_N_LOG_N,
+    COMPLEXITY_N2,
+    COMPLEXITY_NUM
+} complexity_t;
+
+bool is_sort_n_log_n(void (*sort)(struct list_head *head));
+bool is_reverse_linear(void);
+bool is_swap_linear(void);
+bool is_delete_dup_linear(void);
+
+#endif
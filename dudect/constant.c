@@ -21,18 +21,24 @@ const size_t n_measure = N_MEASURE;
 const int drop_size = 20;
 
 /* Maintain a queue independent from the qtest since
- * we do not want the test to affect the original functionality
+ * we do not want the test to affect the original functionality.
+ * Measurements may run on several threads, and each keeps its own queue
+ * and strings.
  */
-static struct list_head *l = NULL;
+static __thread struct list_head *l = NULL;
 
-static char random_string[N_MEASURE][8];
-static int random_string_iter = 0;
+/* Measure the ring buffer engine instead of the linked list */
+static bool dut_ring = false;
+
+static __thread char random_string[N_MEASURE][8];
+static __thread int random_string_iter = 0;
 
 enum {
     test_insert_head,
     test_insert_tail,
     test_remove_head,
     test_remove_tail,
+    test_size,
 };
 
 /* Implement the necessary queue interface to simulation */
@@ -41,6 +47,17 @@ void init_dut(void)
     l = NULL;
 }
 
+void select_dut_engine(bool ring)
+{
+    dut_ring = ring;
+}
+
+/* Create an empty queue backed by the engine under test */
+struct list_head *dut_queue(void)
+{
+    return dut_ring ? q_new_ring() : q_new();
+}
+
 char *get_random_string(void)
 {
     random_string_iter = (random_string_iter + 1) % N_MEASURE;
@@ -66,10 +83,12 @@ void prepare_inputs(uint8_t *input_data, uint8_t *classes)
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode)
+             int mode,
+             perf_counts_t *perf)
 {
     assert(mode == test_insert_head || mode == test_insert_tail ||
-           mode == test_remove_head || mode == test_remove_tail);
+           mode == test_remove_head || mode == test_remove_tail ||
+           mode == test_size);
 
     switch (mode) {
     case test_insert_head:
@@ -79,9 +98,11 @@ void measure(int64_t *before_ticks,
             dut_insert_head(
                 get_random_string(),
                 *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            perf_begin();
             before_ticks[i] = cpucycles();
             dut_insert_head(s, 1);
             after_ticks[i] = cpucycles();
+            perf_end(perf);
             dut_free();
         }
         break;
@@ -92,9 +113,11 @@ void measure(int64_t *before_ticks,
             dut_insert_head(
                 get_random_string(),
                 *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            perf_begin();
             before_ticks[i] = cpucycles();
             dut_insert_tail(s, 1);
             after_ticks[i] = cpucycles();
+            perf_end(perf);
             dut_free();
         }
         break;
@@ -104,9 +127,11 @@ void measure(int64_t *before_ticks,
             dut_insert_head(
                 get_random_string(),
                 *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            perf_begin();
             before_ticks[i] = cpucycles();
             element_t *e = q_remove_head(l, NULL, 0);
             after_ticks[i] = cpucycles();
+            perf_end(perf);
             if (e)
                 q_release_element(e);
             dut_free();
@@ -118,24 +143,29 @@ void measure(int64_t *before_ticks,
             dut_insert_head(
                 get_random_string(),
                 *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            perf_begin();
             before_ticks[i] = cpucycles();
             element_t *e = q_remove_tail(l, NULL, 0);
             after_ticks[i] = cpucycles();
+            perf_end(perf);
             if (e)
                 q_release_element(e);
             dut_free();
         }
         break;
-    default:
+    case test_size:
         for (size_t i = drop_size; i < n_measure - drop_size; i++) {
             dut_new();
             dut_insert_head(
                 get_random_string(),
                 *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            perf_begin();
             before_ticks[i] = cpucycles();
             dut_size(1);
             after_ticks[i] = cpucycles();
+            perf_end(perf);
             dut_free();
         }
+        break;
     }
 }
@@ -1,8 +1,10 @@
 #ifndef DUDECT_CONSTANT_H
 #define DUDECT_CONSTANT_H
 
+#include <stdbool.h>
 #include <stdint.h>
-#define dut_new() ((void) (l = q_new()))
+#include "../perf.h"
+#define dut_new() ((void) (l = dut_queue()))
 
 #define dut_size(n)                                \
     do {                                           \
@@ -27,10 +29,14 @@
 #define dut_free() ((void) (q_free(l)))
 
 void init_dut();
+void select_dut_engine(bool ring);
+struct list_head *dut_queue(void);
 void prepare_inputs(uint8_t *input_data, uint8_t *classes);
+/* Hardware events of the measured calls are counted into perf */
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode);
+             int mode,
+             perf_counts_t *perf);
 
 #endif
@@ -24,15 +24,25 @@
  *
  *  - as long as any of the different test fails, the code will be deemed
  *    variable time.
+ *
+ *  - measurements may be spread over several worker threads, each pinned to
+ *    a CPU and accumulating into its own t_ctx. The contexts are merged after
+ *    every round, and a try ends early once the t statistic is far from the
+ *    threshold.
  */
 
+#define _GNU_SOURCE /* pthread_setaffinity_np */
 #include "fixture.h"
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "../console.h"
 #include "../random.h"
 #include "constant.h"
@@ -41,17 +51,46 @@
 #define enough_measure 10000
 #define test_tries 10
 
+/* Batches each worker measures between two merges */
+#define batches_per_round 4
+
 extern const int drop_size;
 extern const size_t chunk_size;
 extern const size_t n_measure;
 static t_ctx *t;
 
+/* Hardware events of every measured call of the current test */
+static perf_counts_t perf;
+
 /* threshold values for Welch's t-test */
 enum {
     t_threshold_bananas = 500, /* Test failed with overwhelming probability */
     t_threshold_moderate = 10, /* Test failed */
+    t_settled_pass = t_threshold_moderate / 2, /* Passed, stop measuring */
+    t_settled_fail = 2 * t_threshold_moderate, /* Failed, stop measuring */
 };
 
+/* Number of threads measuring, 1 keeps the measurements on the caller */
+static int dudect_threads = 1;
+
+void set_dudect_threads(int nthreads)
+{
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > DUDECT_MAX_THREADS)
+        nthreads = DUDECT_MAX_THREADS;
+    dudect_threads = nthreads;
+}
+
+typedef struct {
+    pthread_t tid;
+    bool spawned;
+    int cpu;
+    int mode;
+    t_ctx t;
+    perf_counts_t perf;
+} worker_t;
+
 static void __attribute__((noreturn)) die(void)
 {
     exit(111);
@@ -65,7 +104,9 @@ static void differentiate(int64_t *exec_times,
         exec_times[i] = after_ticks[i] - before_ticks[i];
 }
 
-static void update_statistics(const int64_t *exec_times, uint8_t *classes)
+static void update_statistics(t_ctx *ctx,
+                              const int64_t *exec_times,
+                              uint8_t *classes)
 {
     for (size_t i = 0; i < n_measure; i++) {
         int64_t difference = exec_times[i];
@@ -74,7 +115,7 @@ static void update_statistics(const int64_t *exec_times, uint8_t *classes)
             continue;
 
         /* do a t-test on the execution time */
-        t_push(t, difference, classes[i]);
+        t_push(ctx, difference, classes[i]);
     }
 }
 
@@ -117,7 +158,8 @@ static bool report(void)
     return true;
 }
 
-static bool doit(int mode)
+/* Measure one batch of n_measure runs and push them into ctx and counts */
+static void measure_batch(t_ctx *ctx, int mode, perf_counts_t *counts)
 {
     int64_t *before_ticks = calloc(n_measure + 1, sizeof(int64_t));
     int64_t *after_ticks = calloc(n_measure + 1, sizeof(int64_t));
@@ -132,18 +174,102 @@ static bool doit(int mode)
 
     prepare_inputs(input_data, classes);
 
-    measure(before_ticks, after_ticks, input_data, mode);
+    measure(before_ticks, after_ticks, input_data, mode, counts);
     differentiate(exec_times, before_ticks, after_ticks);
-    update_statistics(exec_times, classes);
-    bool ret = report();
+    update_statistics(ctx, exec_times, classes);
 
     free(before_ticks);
     free(after_ticks);
     free(exec_times);
     free(classes);
     free(input_data);
+}
+
+static bool doit(int mode)
+{
+    measure_batch(t, mode, &perf);
+    return report();
+}
 
-    return ret;
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    /* Pinning is best effort, measuring unpinned is still valid */
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    for (int i = 0; i < batches_per_round; i++)
+        measure_batch(&w->t, w->mode, &w->perf);
+    if (perf_enabled) {
+        perf_collect(&w->perf);
+        perf_close();
+    }
+    return NULL;
+}
+
+static int online_cpus(void)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1)
+        return 1;
+    return ncpu > DUDECT_MAX_THREADS ? DUDECT_MAX_THREADS : ncpu;
+}
+
+/* Let every worker measure a round of batches, then merge them into t */
+static void run_round(worker_t *workers, int nworkers, int mode)
+{
+    int ncpu = online_cpus();
+
+    /* Signals such as SIGALRM are for the main thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w = &workers[i];
+        w->cpu = i % ncpu;
+        w->mode = mode;
+        t_init(&w->t);
+        memset(&w->perf, 0, sizeof(w->perf));
+        w->spawned = !pthread_create(&w->tid, NULL, worker_main, w);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    for (int i = 0; i < nworkers; i++) {
+        if (workers[i].spawned)
+            pthread_join(workers[i].tid, NULL);
+        else
+            worker_main(&workers[i]);
+        t_merge(t, &workers[i].t);
+        perf_add(&perf, &workers[i].perf);
+    }
+}
+
+/* Whether the verdict can no longer reasonably change */
+static bool settled(void)
+{
+    double max_t = fabs(t_compute(t));
+    if (max_t > t_threshold_bananas)
+        return true;
+    if (t->n[0] + t->n[1] < enough_measure)
+        return false;
+    return max_t < t_settled_pass || max_t > t_settled_fail;
+}
+
+/* Measure the same number of batches as doit would, over nworkers workers */
+static bool doit_parallel(int mode, int nworkers)
+{
+    worker_t workers[DUDECT_MAX_THREADS];
+    int batches = enough_measure / (n_measure - drop_size * 2) + 1;
+    int per_round = nworkers * batches_per_round;
+    bool result = false;
+    for (int done = 0; done < batches; done += per_round) {
+        run_round(workers, nworkers, mode);
+        result = report();
+        if (settled())
+            break;
+    }
+    return result;
 }
 
 static void init_once(void)
@@ -156,18 +282,30 @@ static bool TEST_CONST(char *text, int mode)
 {
     bool result = false;
     t = malloc(sizeof(t_ctx));
+    /* Workers sharing a CPU would only disturb each other's timings */
+    int ncpu = online_cpus();
+    int nworkers = dudect_threads < ncpu ? dudect_threads : ncpu;
+    memset(&perf, 0, sizeof(perf));
 
     for (int cnt = 0; cnt < test_tries; ++cnt) {
         printf("Testing %s...(%d/%d)\n\n", text, cnt, test_tries);
         init_once();
-        for (int i = 0; i < enough_measure / (n_measure - drop_size * 2) + 1;
-             ++i)
-            result = doit(mode);
+        if (nworkers > 1) {
+            result = doit_parallel(mode, nworkers);
+        } else {
+            for (int i = 0;
+                 i < enough_measure / (n_measure - drop_size * 2) + 1; ++i)
+                result = doit(mode);
+        }
         printf("\033[A\033[2K\033[A\033[2K");
         if (result == true)
             break;
     }
     free(t);
+    if (perf_enabled) {
+        perf_collect(&perf);
+        perf_report(text, &perf);
+    }
     return result;
 }
 
@@ -190,3 +328,8 @@ bool is_remove_tail_const(void)
 {
     return TEST_CONST("remove_tail", 3);
 }
+
+bool is_size_const(void)
+{
+    return TEST_CONST("size", 4);
+}
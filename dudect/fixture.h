@@ -9,5 +9,16 @@ bool is_insert_head_const(void);
 bool is_insert_tail_const(void);
 bool is_remove_head_const(void);
 bool is_remove_tail_const(void);
+bool is_size_const(void);
+
+/* Upper bound for set_dudect_threads */
+#define DUDECT_MAX_THREADS 64
+
+/*
+ * Spread the measurements over nthreads worker threads, each pinned to a CPU,
+ * but never more threads than there are CPUs online. With 1, the default,
+ * all measurements run on the calling thread.
+ */
+void set_dudect_threads(int nthreads);
 
 #endif
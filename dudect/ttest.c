@@ -39,6 +39,22 @@ double t_compute(t_ctx *ctx)
     return t_value;
 }
 
+/* Fold the samples accumulated in src into dst, as if pushed there */
+void t_merge(t_ctx *dst, const t_ctx *src)
+{
+    for (int class = 0; class < 2; class ++) {
+        double n = dst->n[class] + src->n[class];
+        if (n == 0)
+            continue;
+        /* Chan et al. pairwise update of mean and sum of squared deviations */
+        double delta = src->mean[class] - dst->mean[class];
+        dst->mean[class] += delta * src->n[class] / n;
+        dst->m2[class] += src->m2[class] +
+                          delta * delta * dst->n[class] * src->n[class] / n;
+        dst->n[class] = n;
+    }
+}
+
 void t_init(t_ctx *ctx)
 {
     for (int class = 0; class < 2; class ++) {
@@ -1,7 +1,9 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,19 +32,52 @@
 /* Data structures used by our code */
 
 /*
- * Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
+ * Every allocated block starts with this header.
+ * The payload follows it, and a magic number is placed after the payload.
  */
 typedef struct BELE {
-    struct BELE *next, *prev;
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_ele_t;
 
-static block_ele_t *allocated = NULL;
-static size_t allocated_count = 0;
+/*
+ * Allocated blocks are tracked in a set, so that cautious mode can tell
+ * whether a block is currently allocated in constant time. The set is split
+ * into shards by block address, each guarded by its own lock, so that threads
+ * allocating and freeing concurrently rarely contend with each other. Each
+ * shard is a hash table with open addressing and linear probing, kept at most
+ * half full. Deletion shifts the following entries back instead of leaving
+ * tombstones behind. The number of allocated blocks is the sum of the shard
+ * counts, gathered when queried.
+ */
+#define BLOCK_SHARD_BITS 6
+#define BLOCK_SHARDS (1 << BLOCK_SHARD_BITS)
+#define BLOCK_SHARD_MIN 64
+
+typedef struct {
+    pthread_mutex_t lock;
+    block_ele_t **slots;
+    size_t cap;
+    size_t count;
+} __attribute__((aligned(COUNT_SHARD_ALIGN))) block_shard_t;
+
+static block_shard_t block_shards[BLOCK_SHARDS];
+static pthread_once_t block_shards_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Running totals of successful calls, counted in the shard of the calling
+ * thread and summed by allocation_totals. Threads share a shard past
+ * COUNT_SHARDS of them, hence the atomics.
+ */
+typedef struct {
+    size_t allocs;
+    size_t frees;
+    size_t bytes;
+} __attribute__((aligned(COUNT_SHARD_ALIGN))) total_shard_t;
+
+static total_shard_t total_shards[COUNT_SHARDS];
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
@@ -61,6 +96,14 @@ static jmp_buf env;
 static volatile sig_atomic_t jmp_ready = false;
 static bool time_limited = false;
 
+/*
+ * Depth of the thread in test_malloc or test_free. Jumping out of them would
+ * leave a shard lock, or the state of the C library allocator, half way
+ * through, hence an exception deferred meanwhile is raised on the way out.
+ */
+static __thread volatile sig_atomic_t harness_depth = 0;
+static __thread char *volatile deferred_message = NULL;
+
 /*
  * Internal functions
  */
@@ -68,10 +111,108 @@ static bool time_limited = false;
 /* Should this allocation fail? */
 static bool fail_allocation()
 {
+    /* random() takes a lock, which threads allocating at once contend for */
+    if (!fail_probability)
+        return false;
     double weight = (double) random() / RAND_MAX;
     return (weight < 0.01 * fail_probability);
 }
 
+static void block_shards_init()
+{
+    for (int i = 0; i < BLOCK_SHARDS; i++)
+        pthread_mutex_init(&block_shards[i].lock, NULL);
+}
+
+static inline uint64_t block_hash(const block_ele_t *b)
+{
+    /* Fibonacci hashing, low bits of block addresses are mostly zero */
+    return (uint64_t) (uintptr_t) b * 0x9e3779b97f4a7c15ULL;
+}
+
+static inline block_shard_t *block_shard(const block_ele_t *b)
+{
+    return &block_shards[block_hash(b) >> (64 - BLOCK_SHARD_BITS)];
+}
+
+static inline size_t block_slot(const block_shard_t *sh, const block_ele_t *b)
+{
+    return (size_t) (block_hash(b) >> 24) & (sh->cap - 1);
+}
+
+static bool shard_grow(block_shard_t *sh)
+{
+    size_t cap = sh->cap ? 2 * sh->cap : BLOCK_SHARD_MIN;
+    block_ele_t **slots = calloc(cap, sizeof(block_ele_t *));
+    if (!slots)
+        return false;
+    block_ele_t **old = sh->slots;
+    size_t old_cap = sh->cap;
+    sh->slots = slots;
+    sh->cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i])
+            continue;
+        size_t j = block_slot(sh, old[i]);
+        while (slots[j])
+            j = (j + 1) & (cap - 1);
+        slots[j] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/* Record b as allocated */
+static bool block_track(block_ele_t *b)
+{
+    pthread_once(&block_shards_once, block_shards_init);
+    block_shard_t *sh = block_shard(b);
+    bool ok = true;
+    pthread_mutex_lock(&sh->lock);
+    if (2 * (sh->count + 1) > sh->cap && !shard_grow(sh)) {
+        ok = false;
+    } else {
+        size_t i = block_slot(sh, b);
+        while (sh->slots[i])
+            i = (i + 1) & (sh->cap - 1);
+        sh->slots[i] = b;
+        sh->count++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return ok;
+}
+
+/* Forget b, return false if it was not recorded as allocated */
+static bool block_untrack(const block_ele_t *b)
+{
+    pthread_once(&block_shards_once, block_shards_init);
+    block_shard_t *sh = block_shard(b);
+    bool found = false;
+    pthread_mutex_lock(&sh->lock);
+    size_t mask = sh->cap - 1, i = 0;
+    if (sh->cap) {
+        i = block_slot(sh, b);
+        while (sh->slots[i] && sh->slots[i] != b)
+            i = (i + 1) & mask;
+        found = sh->slots[i] == b;
+    }
+    if (found) {
+        sh->slots[i] = NULL;
+        for (size_t j = (i + 1) & mask; sh->slots[j]; j = (j + 1) & mask) {
+            /* Move the entry back if its home slot does not lie in (i, j] */
+            size_t home = block_slot(sh, sh->slots[j]);
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                sh->slots[i] = sh->slots[j];
+                sh->slots[j] = NULL;
+                i = j;
+            }
+        }
+        sh->count--;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
 /*
  * Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
@@ -84,20 +225,11 @@ static block_ele_t *find_header(void *p)
     }
 
     block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
-    if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_ele_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
-            report_event(MSG_ERROR,
-                         "Attempted to free unallocated block.  Address = %p",
-                         p);
-            error_occurred = true;
-        }
+    /* Stop tracking the block, in cautious mode make sure it was allocated */
+    if (!block_untrack(b) && cautious_mode) {
+        report_event(MSG_ERROR,
+                     "Attempted to free unallocated block.  Address = %p", p);
+        error_occurred = true;
     }
 
     if (b->magic_header != MAGICHEADER) {
@@ -119,10 +251,26 @@ static size_t *find_footer(block_ele_t *b)
     return p;
 }
 
+static void harness_enter(void)
+{
+    harness_depth++;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static void harness_leave(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (--harness_depth == 0 && deferred_message) {
+        char *msg = deferred_message;
+        deferred_message = NULL;
+        trigger_exception(msg);
+    }
+}
+
 /*
  * Implementation of application functions
  */
-void *test_malloc(size_t size)
+static void *alloc_tracked(size_t size)
 {
     if (noallocate_mode) {
         report_event(MSG_FATAL, "Calls to malloc disallowed");
@@ -136,7 +284,7 @@ void *test_malloc(size_t size)
 
     block_ele_t *new_block =
         malloc(size + sizeof(block_ele_t) + sizeof(size_t));
-    if (!new_block) {
+    if (!new_block || !block_track(new_block)) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
     }
@@ -148,16 +296,17 @@ void *test_malloc(size_t size)
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
-
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
+    total_shard_t *sh = &total_shards[thread_shard()];
+    __atomic_add_fetch(&sh->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sh->bytes, size, __ATOMIC_RELAXED);
+    return p;
+}
 
+void *test_malloc(size_t size)
+{
+    harness_enter();
+    void *p = alloc_tracked(size);
+    harness_leave();
     return p;
 }
 
@@ -173,7 +322,7 @@ void *test_calloc(size_t nelem, size_t elsize)
     return ptr;
 }
 
-void test_free(void *p)
+static void free_tracked(void *p)
 {
     if (noallocate_mode) {
         report_event(MSG_FATAL, "Calls to free disallowed");
@@ -195,19 +344,16 @@ void test_free(void *p)
     b->magic_header = MAGICFREE;
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
-
-    /* Unlink from list */
-    block_ele_t *bn = b->next;
-    block_ele_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
-
     free(b);
-    allocated_count--;
+    __atomic_add_fetch(&total_shards[thread_shard()].frees, 1,
+                       __ATOMIC_RELAXED);
+}
+
+void test_free(void *p)
+{
+    harness_enter();
+    free_tracked(p);
+    harness_leave();
 }
 
 // cppcheck-suppress unusedFunction
@@ -223,7 +369,25 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    pthread_once(&block_shards_once, block_shards_init);
+    size_t count = 0;
+    for (int i = 0; i < BLOCK_SHARDS; i++) {
+        pthread_mutex_lock(&block_shards[i].lock);
+        count += block_shards[i].count;
+        pthread_mutex_unlock(&block_shards[i].lock);
+    }
+    return count;
+}
+
+void allocation_totals(size_t *allocs, size_t *frees, size_t *bytes)
+{
+    *allocs = *frees = *bytes = 0;
+    for (int i = 0, n = thread_shards(); i < n; i++) {
+        const total_shard_t *sh = &total_shards[i];
+        *allocs += __atomic_load_n(&sh->allocs, __ATOMIC_RELAXED);
+        *frees += __atomic_load_n(&sh->frees, __ATOMIC_RELAXED);
+        *bytes += __atomic_load_n(&sh->bytes, __ATOMIC_RELAXED);
+    }
 }
 
 /*
@@ -267,6 +431,8 @@ bool exception_setup(bool limit_time)
     if (sigsetjmp(env, 1)) {
         /* Got here from longjmp */
         jmp_ready = false;
+        harness_depth = 0;
+        deferred_message = NULL;
         if (time_limited) {
             alarm(0);
             time_limited = false;
@@ -313,3 +479,11 @@ void trigger_exception(char *msg)
     else
         exit(1);
 }
+
+void defer_exception(char *msg)
+{
+    if (harness_depth)
+        deferred_message = msg;
+    else
+        trigger_exception(msg);
+}
@@ -22,6 +22,12 @@ char *test_strdup(const char *s);
 /* Report number of allocated blocks */
 size_t allocation_check();
 
+/*
+ * Report running totals of blocks allocated, blocks freed and bytes
+ * allocated through the test functions since start.
+ */
+void allocation_totals(size_t *allocs, size_t *frees, size_t *bytes);
+
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
@@ -58,6 +64,13 @@ void exception_cancel();
  */
 void trigger_exception(char *msg);
 
+/*
+ * Like trigger_exception, but held off while the calling thread is inside
+ * test_malloc or test_free, and raised as soon as it leaves. For the handlers
+ * of asynchronous signals, which may interrupt them at any point.
+ */
+void defer_exception(char *msg);
+
 #else /* !INTERNAL */
 
 /* Tested program use our versions of malloc and free */
@@ -0,0 +1,188 @@
+#include "latency.h"
+#include <string.h>
+
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+#include "report.h"
+
+/*
+ * Each power of two is split into 2^LAT_SUB_BITS buckets, so a value is
+ * known within 1/8 of itself. Values below 2^LAT_SUB_BITS get a bucket each.
+ */
+#define LAT_SUB_BITS 3
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS (64 * LAT_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t bucket[LAT_BUCKETS];
+} lat_hist_t;
+
+static const char *lat_names[LAT_NUM] = {
+    [LAT_NEW] = "new",
+    [LAT_FREE] = "free",
+    [LAT_INSERT_HEAD] = "insert_head",
+    [LAT_INSERT_TAIL] = "insert_tail",
+    [LAT_REMOVE_HEAD] = "remove_head",
+    [LAT_REMOVE_TAIL] = "remove_tail",
+    [LAT_SIZE] = "size",
+    [LAT_REVERSE] = "reverse",
+    [LAT_SORT] = "sort",
+    [LAT_DELETE_MID] = "delete_mid",
+    [LAT_DELETE_DUP] = "delete_dup",
+    [LAT_SWAP] = "swap",
+    [LAT_REVERSEK] = "reverseK",
+    [LAT_MERGE] = "merge",
+};
+
+static lat_hist_t hists[LAT_NUM];
+
+typedef struct {
+    uint64_t calls;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;
+} mem_tally_t;
+
+/* Tallies per operation, and of every call since the last command report */
+static mem_tally_t tallies[LAT_NUM], command_tally;
+
+/* Harness totals when the current call started */
+static size_t start_allocs, start_frees, start_bytes;
+
+bool lat_enabled = false;
+
+static inline int bucket_of(uint64_t v)
+{
+    if (v < LAT_SUB)
+        return (int) v;
+    int msb = 63 - __builtin_clzll(v);
+    int sub = (v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1);
+    return ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + sub;
+}
+
+/* Largest value falling into bucket i */
+static uint64_t bucket_max(int i)
+{
+    if (i < LAT_SUB)
+        return i;
+    int shift = (i >> LAT_SUB_BITS) - 1;
+    uint64_t low = (uint64_t) (LAT_SUB + (i & (LAT_SUB - 1))) << shift;
+    return low + ((uint64_t) 1 << shift) - 1;
+}
+
+void lat_record(lat_op_t op, int64_t cycles)
+{
+    lat_hist_t *h = &hists[op];
+    uint64_t v = cycles > 0 ? cycles : 0;
+    h->count++;
+    h->sum += v;
+    if (v > h->max)
+        h->max = v;
+    h->bucket[bucket_of(v)]++;
+}
+
+void lat_reset(void)
+{
+    memset(hists, 0, sizeof(hists));
+}
+
+/* Upper bound of the q-quantile, never beyond the largest value seen */
+static uint64_t quantile(const lat_hist_t *h, double q)
+{
+    uint64_t rank = (uint64_t) (q * h->count);
+    if (rank < h->count)
+        rank++;
+    uint64_t seen = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void lat_report(void)
+{
+    report(1, "%-12s %10s %10s %10s %10s %10s %10s", "op", "count", "mean",
+           "p50", "p99", "p999", "max");
+    for (int op = 0; op < LAT_NUM; op++) {
+        const lat_hist_t *h = &hists[op];
+        if (!h->count)
+            continue;
+        report(1, "%-12s %10lu %10.0f %10lu %10lu %10lu %10lu", lat_names[op],
+               h->count, (double) h->sum / h->count, quantile(h, 0.5),
+               quantile(h, 0.99), quantile(h, 0.999), h->max);
+    }
+}
+
+bool lat_dump_csv(FILE *fp)
+{
+    if (fprintf(fp, "op,count,mean,p50,p99,p999,max\n") < 0)
+        return false;
+    for (int op = 0; op < LAT_NUM; op++) {
+        const lat_hist_t *h = &hists[op];
+        if (!h->count)
+            continue;
+        if (fprintf(fp, "%s,%lu,%.1f,%lu,%lu,%lu,%lu\n", lat_names[op],
+                    h->count, (double) h->sum / h->count, quantile(h, 0.5),
+                    quantile(h, 0.99), quantile(h, 0.999), h->max) < 0)
+            return false;
+    }
+    return true;
+}
+
+void mem_begin(void)
+{
+    allocation_totals(&start_allocs, &start_frees, &start_bytes);
+}
+
+void mem_end(lat_op_t op, int calls)
+{
+    size_t allocs, frees, bytes;
+    allocation_totals(&allocs, &frees, &bytes);
+    mem_tally_t delta = {calls, allocs - start_allocs, frees - start_frees,
+                         bytes - start_bytes};
+    mem_tally_t *tallied[] = {&tallies[op], &command_tally};
+    for (size_t i = 0; i < sizeof(tallied) / sizeof(tallied[0]); i++) {
+        tallied[i]->calls += delta.calls;
+        tallied[i]->allocs += delta.allocs;
+        tallied[i]->frees += delta.frees;
+        tallied[i]->bytes += delta.bytes;
+    }
+}
+
+void mem_reset(void)
+{
+    memset(tallies, 0, sizeof(tallies));
+    memset(&command_tally, 0, sizeof(command_tally));
+}
+
+void mem_report(void)
+{
+    report(1, "%-12s %10s %12s %12s %12s", "op", "calls", "allocs/op",
+           "frees/op", "B/op");
+    for (int op = 0; op < LAT_NUM; op++) {
+        const mem_tally_t *m = &tallies[op];
+        if (!m->calls)
+            continue;
+        report(1, "%-12s %10lu %12.1f %12.1f %12.0f", lat_names[op], m->calls,
+               (double) m->allocs / m->calls, (double) m->frees / m->calls,
+               (double) m->bytes / m->calls);
+    }
+}
+
+void mem_command_done(const char *name)
+{
+    const mem_tally_t *m = &command_tally;
+    if (name && m->calls)
+        report(1, "%s: %.1f allocs/op, %.1f frees/op, %.0f B/op", name,
+               (double) m->allocs / m->calls, (double) m->frees / m->calls,
+               (double) m->bytes / m->calls);
+    memset(&command_tally, 0, sizeof(command_tally));
+}
@@ -0,0 +1,79 @@
+#ifndef LAB0_LATENCY_H
+#define LAB0_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "dudect/cpucycles.h"
+
+/*
+ * Instrumentation of queue API calls.
+ * When enabled, qtest records the duration of each call in CPU cycles, into
+ * a log-bucketed histogram kept per operation. The allocations and frees
+ * each call makes through the harness are always counted per operation.
+ */
+
+typedef enum {
+    LAT_NEW,
+    LAT_FREE,
+    LAT_INSERT_HEAD,
+    LAT_INSERT_TAIL,
+    LAT_REMOVE_HEAD,
+    LAT_REMOVE_TAIL,
+    LAT_SIZE,
+    LAT_REVERSE,
+    LAT_SORT,
+    LAT_DELETE_MID,
+    LAT_DELETE_DUP,
+    LAT_SWAP,
+    LAT_REVERSEK,
+    LAT_MERGE,
+    LAT_NUM
+} lat_op_t;
+
+extern bool lat_enabled;
+
+/* Count what the harness allocates between these two, as calls of op */
+void mem_begin(void);
+void mem_end(lat_op_t op, int calls);
+
+/* Start timing a call, cheap enough to leave in place when disabled */
+static inline int64_t lat_begin(void)
+{
+    mem_begin();
+    return lat_enabled ? cpucycles() : 0;
+}
+
+/* Record a call of op which started at start */
+void lat_record(lat_op_t op, int64_t cycles);
+
+static inline void lat_end(lat_op_t op, int64_t start)
+{
+    if (lat_enabled)
+        lat_record(op, cpucycles() - start);
+    mem_end(op, 1);
+}
+
+/* Discard all recorded calls */
+void lat_reset(void);
+
+/* Print count, mean, p50, p99, p999 and max of every recorded operation */
+void lat_report(void);
+
+/* Write the same figures as comma-separated values, return false on error */
+bool lat_dump_csv(FILE *fp);
+
+/* Discard all allocation counts */
+void mem_reset(void);
+
+/* Print calls, allocations, frees and bytes per call of every operation */
+void mem_report(void);
+
+/*
+ * Close the tally of the calls made since the previous call, and print their
+ * allocations per call headed by name. Print nothing if name is NULL or no
+ * call was made.
+ */
+void mem_command_done(const char *name);
+
+#endif /* LAB0_LATENCY_H */
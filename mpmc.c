@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "mpmc.h"
+
+#define CACHE_LINE 64
+
+/* Hazard pointers per thread: the head or tail, and the node after it */
+#define MPMC_HAZARDS 2
+
+/* Retired nodes one thread may hold, more than all the hazard pointers */
+#define MPMC_RETIRED (2 * MPMC_HAZARDS * MPMC_MAX_THREADS)
+
+/* Fewest retired nodes worth scanning the hazard pointers for */
+#define MPMC_MIN_SCAN 64
+
+typedef struct mpmc_node {
+    struct mpmc_node *next;
+    size_t len;
+    char value[];
+} mpmc_node_t;
+
+/* Padded to a cache line, as other threads read the hazard pointers */
+typedef struct {
+    mpmc_node_t *hazard[MPMC_HAZARDS];
+    int nretired;
+    mpmc_node_t *retired[MPMC_RETIRED];
+    char pad[CACHE_LINE];
+} mpmc_thread_t;
+
+/* head and tail sit on cache lines of their own, as both are contended */
+struct mpmc {
+    mpmc_node_t *head;
+    char pad_head[CACHE_LINE - sizeof(mpmc_node_t *)];
+    mpmc_node_t *tail;
+    char pad_tail[CACHE_LINE - sizeof(mpmc_node_t *)];
+    int nthreads;
+    int scan_at; /* Retired nodes which trigger a scan */
+    mpmc_thread_t threads[];
+};
+
+static mpmc_node_t *node_new(const char *s, size_t len)
+{
+    mpmc_node_t *n = malloc(sizeof(mpmc_node_t) + len + 1);
+    if (!n)
+        return NULL;
+    n->next = NULL;
+    n->len = len;
+    memcpy(n->value, s, len + 1);
+    return n;
+}
+
+mpmc_t *mpmc_new(int nthreads)
+{
+    if (nthreads < 1 || nthreads > MPMC_MAX_THREADS)
+        return NULL;
+    mpmc_t *q = malloc(sizeof(mpmc_t) + nthreads * sizeof(mpmc_thread_t));
+    if (!q)
+        return NULL;
+    mpmc_node_t *dummy = node_new("", 0);
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+    q->head = q->tail = dummy;
+    q->nthreads = nthreads;
+    q->scan_at = 2 * MPMC_HAZARDS * nthreads;
+    if (q->scan_at < MPMC_MIN_SCAN)
+        q->scan_at = MPMC_MIN_SCAN;
+    for (int i = 0; i < nthreads; i++) {
+        memset(q->threads[i].hazard, 0, sizeof(q->threads[i].hazard));
+        q->threads[i].nretired = 0;
+    }
+    return q;
+}
+
+void mpmc_free(mpmc_t *q)
+{
+    if (!q)
+        return;
+    mpmc_node_t *n = q->head;
+    while (n) {
+        mpmc_node_t *next = n->next;
+        free(n);
+        n = next;
+    }
+    for (int i = 0; i < q->nthreads; i++) {
+        for (int j = 0; j < q->threads[i].nretired; j++)
+            free(q->threads[i].retired[j]);
+    }
+    free(q);
+}
+
+/*
+ * Publish p as hazard slot of thread t, then check that it is still found
+ * at src. Once this returns true, p is not freed until the slot changes.
+ */
+static inline bool protect(mpmc_thread_t *t,
+                           int slot,
+                           mpmc_node_t *p,
+                           mpmc_node_t **src)
+{
+    __atomic_store_n(&t->hazard[slot], p, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(src, __ATOMIC_SEQ_CST) == p;
+}
+
+static inline void release(mpmc_thread_t *t)
+{
+    for (int i = 0; i < MPMC_HAZARDS; i++)
+        __atomic_store_n(&t->hazard[i], NULL, __ATOMIC_RELEASE);
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) *(mpmc_node_t *const *) a;
+    uintptr_t y = (uintptr_t) *(mpmc_node_t *const *) b;
+    return (x > y) - (x < y);
+}
+
+/* Free the retired nodes of thread t which no hazard pointer refers to */
+static void scan(mpmc_t *q, mpmc_thread_t *t)
+{
+    mpmc_node_t *hp[MPMC_HAZARDS * MPMC_MAX_THREADS];
+    int nhp = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < q->nthreads; i++) {
+        for (int j = 0; j < MPMC_HAZARDS; j++) {
+            mpmc_node_t *p =
+                __atomic_load_n(&q->threads[i].hazard[j], __ATOMIC_ACQUIRE);
+            if (p)
+                hp[nhp++] = p;
+        }
+    }
+    qsort(hp, nhp, sizeof(mpmc_node_t *), cmp_ptr);
+
+    int kept = 0;
+    for (int i = 0; i < t->nretired; i++) {
+        mpmc_node_t *p = t->retired[i];
+        if (bsearch(&p, hp, nhp, sizeof(mpmc_node_t *), cmp_ptr))
+            t->retired[kept++] = p;
+        else
+            free(p);
+    }
+    t->nretired = kept;
+}
+
+static void retire(mpmc_t *q, mpmc_thread_t *t, mpmc_node_t *p)
+{
+    t->retired[t->nretired++] = p;
+    if (t->nretired >= q->scan_at)
+        scan(q, t);
+}
+
+bool mpmc_insert_tail(mpmc_t *q, int tid, const char *s)
+{
+    mpmc_node_t *n = node_new(s, strlen(s));
+    if (!n)
+        return false;
+
+    mpmc_thread_t *t = &q->threads[tid];
+    for (;;) {
+        mpmc_node_t *tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (!protect(t, 0, tail, &q->tail))
+            continue;
+        mpmc_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (next) {
+            /* Help the insertion which has not swung the tail yet */
+            __atomic_compare_exchange_n(&q->tail, &tail, next, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            continue;
+        }
+        mpmc_node_t *expected = NULL;
+        if (__atomic_compare_exchange_n(&tail->next, &expected, n, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            __atomic_compare_exchange_n(&q->tail, &tail, n, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    release(t);
+    return true;
+}
+
+bool mpmc_remove_head(mpmc_t *q, int tid, char *sp, size_t bufsize)
+{
+    mpmc_thread_t *t = &q->threads[tid];
+    mpmc_node_t *head, *next;
+    for (;;) {
+        head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (!protect(t, 0, head, &q->head))
+            continue;
+        next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+        /* While head stays put, next cannot have been removed either */
+        if (!protect(t, 1, next, &head->next) ||
+            __atomic_load_n(&q->head, __ATOMIC_SEQ_CST) != head)
+            continue;
+        if (!next) {
+            release(t);
+            return false;
+        }
+        mpmc_node_t *tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            /* Tail lags behind an insertion, move it on before head */
+            __atomic_compare_exchange_n(&q->tail, &tail, next, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&q->head, &head, next, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+
+    /* next is the new dummy, its string belongs to this thread alone */
+    if (sp && bufsize) {
+        size_t n = next->len < bufsize - 1 ? next->len : bufsize - 1;
+        memcpy(sp, next->value, n);
+        sp[n] = '\0';
+    }
+    release(t);
+    retire(q, t, head);
+    return true;
+}
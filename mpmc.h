@@ -0,0 +1,52 @@
+#ifndef LAB0_MPMC_H
+#define LAB0_MPMC_H
+
+/*
+ * Concurrent queue of strings, for any number of producers and consumers.
+ *
+ * It is the lock-free queue of Michael and Scott: a singly-linked list which
+ * always starts with a dummy node, extended at the tail and consumed at the
+ * head by compare-and-swap. Removed nodes are reclaimed with hazard pointers,
+ * so memory goes back through the harness allocator while other threads may
+ * still be reading it.
+ *
+ * Every thread using the queue passes its own id, between 0 and the number
+ * of threads given to mpmc_new minus 1. Two threads must not use the same id
+ * at the same time.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Maximum number of threads sharing a queue */
+#define MPMC_MAX_THREADS 64
+
+typedef struct mpmc mpmc_t;
+
+/*
+ * Create empty queue shared by nthreads threads.
+ * Return NULL if nthreads is out of range or could not allocate space.
+ */
+mpmc_t *mpmc_new(int nthreads);
+
+/*
+ * Free all storage used by queue, including nodes waiting to be reclaimed.
+ * No other thread may be using the queue. No effect if q is NULL.
+ */
+void mpmc_free(mpmc_t *q);
+
+/*
+ * Attempt to insert a copy of s at tail of queue.
+ * Return true if successful, false if could not allocate space.
+ */
+bool mpmc_insert_tail(mpmc_t *q, int tid, const char *s);
+
+/*
+ * Attempt to remove the element at head of queue.
+ * If sp is non-NULL, up to bufsize-1 characters of the removed string are
+ * copied to it, followed by a null terminator.
+ * Return true if successful, false if queue is empty.
+ */
+bool mpmc_remove_head(mpmc_t *q, int tid, char *sp, size_t bufsize);
+
+#endif /* LAB0_MPMC_H */
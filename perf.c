@@ -0,0 +1,158 @@
+#include "perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "report.h"
+
+#define HW_CACHE(cache, op, result)                                   \
+    ((PERF_COUNT_HW_CACHE_##cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} events[PERF_EVENTS] = {
+    [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+                           "instructions"},
+    [PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE, HW_CACHE(L1D, READ, MISS),
+                         "L1d misses"},
+    [PERF_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+                         "LLC misses"},
+    [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+                            "branch misses"},
+};
+
+int perf_enabled = 0;
+
+/* Counters of one thread, all in the group of the first one opened */
+typedef struct {
+    bool tried;
+    int leader;
+    int fd[PERF_EVENTS];
+    int slot[PERF_EVENTS]; /* Position of the event in a group read */
+    int n;
+    int err; /* errno of the last event which could not be opened */
+} perf_group_t;
+
+static __thread perf_group_t group = {.leader = -1};
+
+static int event_open(perf_event_t ev, int leader)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[ev].type;
+    attr.config = events[ev].config;
+    /* The group starts stopped, members follow their leader */
+    attr.disabled = leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, leader,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+bool perf_open(const char **why)
+{
+    perf_group_t *g = &group;
+    if (!g->tried) {
+        g->tried = true;
+        g->leader = -1;
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            g->fd[i] = event_open(i, g->leader);
+            g->slot[i] = -1;
+            if (g->fd[i] < 0) {
+                g->err = errno;
+                continue;
+            }
+            if (g->leader < 0)
+                g->leader = g->fd[i];
+            g->slot[i] = g->n++;
+        }
+    }
+    if (why)
+        *why = g->n ? NULL : strerror(g->err);
+    return g->n > 0;
+}
+
+void perf_close(void)
+{
+    perf_group_t *g = &group;
+    for (int i = 0; g->tried && i < PERF_EVENTS; i++) {
+        if (g->fd[i] >= 0)
+            close(g->fd[i]);
+    }
+    memset(g, 0, sizeof(*g));
+    g->leader = -1;
+}
+
+void perf_resume(void)
+{
+    if (perf_open(NULL))
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_pause(void)
+{
+    if (group.n)
+        ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_collect(perf_counts_t *c)
+{
+    perf_group_t *g = &group;
+    if (!g->n)
+        return;
+    uint64_t buf[1 + PERF_EVENTS];
+    ssize_t len = read(g->leader, buf, sizeof(buf));
+    ioctl(g->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    if (len < (ssize_t) sizeof(uint64_t) || buf[0] != g->n)
+        return;
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (g->slot[i] < 0)
+            continue;
+        c->count[i] += buf[1 + g->slot[i]];
+        c->mask |= 1u << i;
+    }
+}
+
+void perf_add(perf_counts_t *c, const perf_counts_t *d)
+{
+    for (int i = 0; i < PERF_EVENTS; i++)
+        c->count[i] += d->count[i];
+    c->mask |= d->mask;
+    c->runs += d->runs;
+}
+
+void perf_report(const char *name, const perf_counts_t *c)
+{
+    if (!c->mask) {
+        report(1, "%s: no performance counters available", name);
+        return;
+    }
+    uint64_t runs = c->runs ? c->runs : 1;
+    report_noreturn(1, "%s:", name);
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (c->mask & (1u << i))
+            report_noreturn(1, " %s %.1f", events[i].name,
+                            (double) c->count[i] / runs);
+        else
+            report_noreturn(1, " %s n/a", events[i].name);
+    }
+    const unsigned int ipc = 1u << PERF_CYCLES | 1u << PERF_INSTRUCTIONS;
+    if ((c->mask & ipc) == ipc && c->count[PERF_CYCLES])
+        report_noreturn(1, " (IPC %.2f)",
+                        (double) c->count[PERF_INSTRUCTIONS] /
+                            c->count[PERF_CYCLES]);
+    if (runs > 1)
+        report(1, " per run, over %lu runs", (unsigned long) runs);
+    else
+        report(1, "");
+}
@@ -0,0 +1,71 @@
+#ifndef LAB0_PERF_H
+#define LAB0_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hardware performance counters, read through perf_event_open(2).
+ * Each thread opens its own group of counters the first time it counts,
+ * and only its own user space execution is counted. Events the CPU or the
+ * kernel does not provide are left out; if none can be opened, nothing is
+ * counted and the reports say so.
+ */
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS
+} perf_event_t;
+
+/* Counts summed over runs measured regions */
+typedef struct {
+    uint64_t count[PERF_EVENTS];
+    unsigned int mask; /* Bit i is set if event i was counted */
+    uint64_t runs;
+} perf_counts_t;
+
+/* Whether regions are counted, set by the perf option of the console */
+extern int perf_enabled;
+
+/*
+ * Open the counters of the calling thread, if not done yet.
+ * Return false if no event is available, with the reason in *why.
+ */
+bool perf_open(const char **why);
+
+/* Close the counters of the calling thread, before it exits */
+void perf_close(void);
+
+/* Start and stop counting in the calling thread */
+void perf_resume(void);
+void perf_pause(void);
+
+/* Add what the calling thread counted to c and start again from zero */
+void perf_collect(perf_counts_t *c);
+
+/* Add the counts and runs of d to c */
+void perf_add(perf_counts_t *c, const perf_counts_t *d);
+
+/* Print the counts per run, headed by name */
+void perf_report(const char *name, const perf_counts_t *c);
+
+/* Count a measured region, cheap enough to leave in place when disabled */
+static inline void perf_begin(void)
+{
+    if (perf_enabled)
+        perf_resume();
+}
+
+static inline void perf_end(perf_counts_t *c)
+{
+    if (perf_enabled) {
+        perf_pause();
+        c->runs++;
+    }
+}
+
+#endif /* LAB0_PERF_H */
@@ -1,23 +1,32 @@
 /* Implementation of testing code for queue code */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include "dudect/complexity.h"
 #include "dudect/fixture.h"
 #include "list.h"
 
 /* Our program needs to use regular malloc/free */
 #define INTERNAL 1
 #include "harness.h"
+#include "latency.h"
+#include "mpmc.h"
+#include "random.h"
 
 /* What character limit will be used for displaying strings? */
 #define MAXSTRING 1024
@@ -34,6 +43,7 @@
 #include "console.h"
 #include "queue.h"
 #include "report.h"
+#include "shuffle.h"
 
 /* Settable parameters */
 
@@ -42,7 +52,6 @@
 /*
  * How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST 30
 static int big_list_size = BIG_LIST;
@@ -62,12 +71,49 @@ static list_head_meta_t l_meta;
 /* Number of elements in queue */
 static size_t lcnt = 0;
 
+/*
+ * Named queues, chained for q_merge.
+ * l_meta and lcnt belong to the current queue, they are stored back in its
+ * entry before another queue is switched to or the chain is walked.
+ */
+typedef struct {
+    queue_context_t ctx;
+    char *name;
+    size_t lcnt;
+} named_queue_t;
+
+static LIST_HEAD(queue_chain);
+static named_queue_t *current;
+
+#define DEFAULT_QUEUE "0"
+
 /* How many times can queue operations fail */
 static int fail_limit = BIG_LIST;
 static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/* Whether elements are allocated from slab pool */
+static int pool_mode = 0;
+
+/* Number of threads used for sorting */
+static int sort_threads = 1;
+
+/* Number of threads measuring in simulation mode */
+static int sim_threads = 1;
+
+/* Whether rh/rt take the removed element without copying its string */
+static int zerocopy = 0;
+
+/* Whether the latency of queue API calls is recorded */
+static int instrument = 0;
+
+/* Whether allocations per call are reported after every command */
+static int memstat_line = 0;
+
+/* Seed of the generator used by shuffle, seeded from the time by default */
+static int seed = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -75,6 +121,56 @@ static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
 /* Forward declarations */
 static bool show_queue(int vlevel);
 
+static void queue_store()
+{
+    current->ctx.q = l_meta.l;
+    current->ctx.size = l_meta.size;
+    current->lcnt = lcnt;
+}
+
+static void queue_load(named_queue_t *nq)
+{
+    current = nq;
+    l_meta.l = nq->ctx.q;
+    l_meta.size = nq->ctx.size;
+    lcnt = nq->lcnt;
+}
+
+/* Look up the queue called name, appending an empty one if there is none */
+static named_queue_t *queue_find(const char *name)
+{
+    named_queue_t *nq;
+    list_for_each_entry (nq, &queue_chain, ctx.chain) {
+        if (!strcmp(nq->name, name))
+            return nq;
+    }
+
+    nq = malloc(sizeof(named_queue_t));
+    if (!nq)
+        return NULL;
+    nq->name = strdup(name);
+    if (!nq->name) {
+        free(nq);
+        return NULL;
+    }
+    nq->ctx.q = NULL;
+    nq->ctx.size = 0;
+    nq->lcnt = 0;
+    list_add_tail(&nq->ctx.chain, &queue_chain);
+    return nq;
+}
+
+/* Whether a queue other than the current one still holds allocations */
+static bool other_queues_live()
+{
+    named_queue_t *nq;
+    list_for_each_entry (nq, &queue_chain, ctx.chain) {
+        if (nq != current && nq->ctx.q)
+            return true;
+    }
+    return false;
+}
+
 static bool do_free(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -87,18 +183,27 @@ static bool do_free(int argc, char *argv[])
         report(3, "Warning: Calling free on null queue");
     error_check();
 
-    if (lcnt > big_list_size)
-        set_cautious_mode(false);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         q_free(l_meta.l);
+        lat_end(LAT_FREE, t0);
+    }
     exception_cancel();
-    set_cautious_mode(true);
 
     l_meta.size = 0;
     l_meta.l = NULL;
     lcnt = 0;
     show_queue(3);
 
+    /*
+     * The blocks of the other queues cannot be told apart, pooled elements
+     * even share slabs across queues. Thus leaks are only checked once the
+     * last queue is freed, which covers every queue freed before it.
+     */
+    if (other_queues_live()) {
+        report(3, "Checking for leaks once the other queues are freed");
+        return ok && !error_check();
+    }
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
@@ -111,20 +216,27 @@ static bool do_free(int argc, char *argv[])
 
 static bool do_new(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    bool ring = false;
+    if (argc == 2 && !strcmp(argv[1], "ring")) {
+        ring = true;
+    } else if (argc > 2 || (argc == 2 && strcmp(argv[1], "list"))) {
+        report(1, "%s takes an optional engine: list or ring", argv[0]);
         return false;
     }
 
     bool ok = true;
     if (l_meta.l) {
         report(3, "Freeing old queue");
-        ok = do_free(argc, argv);
+        ok = do_free(1, argv);
     }
     error_check();
 
+    /* Simulation mode measures the engine of the latest queue */
+    select_dut_engine(ring);
     if (exception_setup(true)) {
-        l_meta.l = q_new();
+        int64_t t0 = lat_begin();
+        l_meta.l = ring ? q_new_ring() : q_new();
+        lat_end(LAT_NEW, t0);
         l_meta.size = 0;
     }
     exception_cancel();
@@ -134,22 +246,178 @@ static bool do_new(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_switch(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes an optional queue name", argv[0]);
+        return false;
+    }
+
+    queue_store();
+    named_queue_t *nq;
+    if (argc == 1) {
+        list_for_each_entry (nq, &queue_chain, ctx.chain) {
+            if (nq->ctx.q)
+                report(1, "%c %s: %zu elements", nq == current ? '*' : ' ',
+                       nq->name, nq->lcnt);
+            else
+                report(1, "%c %s: NULL", nq == current ? '*' : ' ', nq->name);
+        }
+        return true;
+    }
+
+    nq = queue_find(argv[1]);
+    if (!nq) {
+        report(1, "ERROR: Could not allocate queue '%s'", argv[1]);
+        return false;
+    }
+    queue_load(nq);
+    show_queue(3);
+    return true;
+}
+
 /*
  * TODO: Add a buf_size check of if the buf_size may be less
  * than MIN_RANDSTR_LEN.
  */
 static void fill_rand_string(char *buf, size_t buf_size)
 {
-    size_t len = 0;
-    while (len < MIN_RANDSTR_LEN)
-        len = rand() % buf_size;
+    uint16_t r;
+    randombytes((uint8_t *) &r, sizeof(r));
+    size_t len = MIN_RANDSTR_LEN + ((r * (buf_size - MIN_RANDSTR_LEN)) >> 16);
 
-    for (size_t n = 0; n < len; n++) {
-        buf[n] = charset[rand() % (sizeof charset - 1)];
-    }
+    randomchars(buf, len, charset, sizeof charset - 1);
     buf[len] = '\0';
 }
 
+/* Fill n buffers of buf_size bytes each, laid out back to back in buf */
+static void fill_rand_strings(char *buf, int n, size_t buf_size)
+{
+    randomchars(buf, (size_t) n * buf_size, charset, sizeof charset - 1);
+    for (int i = 0; i < n; i++) {
+        uint16_t r;
+        randombytes((uint8_t *) &r, sizeof(r));
+        size_t len =
+            MIN_RANDSTR_LEN + ((r * (buf_size - MIN_RANDSTR_LEN)) >> 16);
+        buf[(size_t) i * buf_size + len] = '\0';
+    }
+}
+
+/* Outcome of insert_bulk */
+typedef enum {
+    BULK_INSERTED, /* *ok tells whether the checks passed */
+    BULK_NOMEM,    /* Nothing inserted, insert the elements one by one */
+    BULK_EXCEPTION /* Time limit or other exception, already reported */
+} bulk_result_t;
+
+/* Insert reps elements at once through the bulk API */
+static bulk_result_t insert_bulk(bool tail,
+                                 char *inserts,
+                                 bool need_rand,
+                                 int reps,
+                                 bool *ok)
+{
+    char *buf = NULL;
+    char **sv = &inserts;
+    int nstr = 1;
+    if (need_rand) {
+        buf = malloc((size_t) reps * MAX_RANDSTR_LEN);
+        sv = malloc((size_t) reps * sizeof(char *));
+        if (!buf || !sv) {
+            free(buf);
+            free(sv);
+            return BULK_NOMEM;
+        }
+        fill_rand_strings(buf, reps, MAX_RANDSTR_LEN);
+        for (int r = 0; r < reps; r++)
+            sv[r] = buf + (size_t) r * MAX_RANDSTR_LEN;
+        nstr = reps;
+    }
+
+    bool rval = false;
+    if (exception_setup(true)) {
+        mem_begin();
+        rval = tail ? q_insert_tail_bulk(l_meta.l, sv, nstr, reps)
+                    : q_insert_head_bulk(l_meta.l, sv, nstr, reps);
+        /* The batch stands for reps insertions */
+        mem_end(tail ? LAT_INSERT_TAIL : LAT_INSERT_HEAD, rval ? reps : 1);
+    }
+    exception_cancel();
+
+    if (need_rand) {
+        free(buf);
+        free(sv);
+    }
+    /* An exception leaves rval false too, and an error behind */
+    if (!rval)
+        return error_check() ? BULK_EXCEPTION : BULK_NOMEM;
+
+    lcnt += reps;
+    l_meta.size += reps;
+    q_link(l_meta.l);
+    struct list_head *cur = tail ? l_meta.l->prev : l_meta.l->next;
+    char *cur_inserts = list_entry(cur, element_t, list)->value;
+    char *next_inserts =
+        list_entry(tail ? cur->prev : cur->next, element_t, list)->value;
+    *ok = true;
+    if (!cur_inserts || !next_inserts) {
+        report(1, "ERROR: Failed to save copy of string in queue");
+        *ok = false;
+    } else if (!need_rand && inserts == cur_inserts) {
+        report(1,
+               "ERROR: Need to allocate and copy string for new "
+               "queue element");
+        *ok = false;
+    } else if (cur_inserts == next_inserts) {
+        report(1,
+               "ERROR: Need to allocate separate string for each "
+               "queue element");
+        *ok = false;
+    }
+    *ok = *ok && !error_check();
+    return BULK_INSERTED;
+}
+
+/*
+ * Insert reps elements through insert_bulk where it applies. Return true if
+ * the command is done, with its verdict in *ok, or false to fall back to
+ * inserting the elements one by one.
+ */
+static bool try_insert_bulk(bool tail,
+                            char *inserts,
+                            bool need_rand,
+                            int reps,
+                            bool *ok)
+{
+    /* Time every insertion on its own when instrumented */
+    if (reps <= 1 || !l_meta.l || lat_enabled)
+        return false;
+
+    switch (insert_bulk(tail, inserts, need_rand, reps, ok)) {
+    case BULK_NOMEM:
+        return false;
+    case BULK_EXCEPTION:
+        fail_count++;
+        *ok = false;
+        break;
+    default:
+        break;
+    }
+    show_queue(3);
+    return true;
+}
+
+/* Report the verdict of a complexity test in simulation mode */
+static bool complexity_verdict(bool ok, char *bound)
+{
+    if (!ok) {
+        report(1, "ERROR: Probably grows faster than %s", bound);
+        return false;
+    }
+    report(1, "Probably %s", bound);
+    return true;
+}
+
 /* insert head */
 static bool do_ih(int argc, char *argv[])
 {
@@ -193,16 +461,20 @@ static bool do_ih(int argc, char *argv[])
         report(3, "Warning: Calling insert head on null queue");
     error_check();
 
+    if (try_insert_bulk(false, inserts, need_rand, reps, &ok))
+        return ok;
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            int64_t t0 = lat_begin();
             bool rval = q_insert_head(l_meta.l, inserts);
+            lat_end(LAT_INSERT_HEAD, t0);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->next, element_t, list)->value;
+                char *cur_inserts = q_peek_head(l_meta.l)->value;
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
@@ -282,16 +554,20 @@ static bool do_it(int argc, char *argv[])
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
 
+    if (try_insert_bulk(true, inserts, need_rand, reps, &ok))
+        return ok;
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            int64_t t0 = lat_begin();
             bool rval = q_insert_tail(l_meta.l, inserts);
+            lat_end(LAT_INSERT_TAIL, t0);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->prev, element_t, list)->value;
+                char *cur_inserts = q_peek_tail(l_meta.l)->value;
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
@@ -315,6 +591,62 @@ static bool do_it(int argc, char *argv[])
     return ok;
 }
 
+/*
+ * Zero-copy variant of do_remove. The removed string is checked through the
+ * returned element, against the length reported along with it.
+ */
+static bool do_take(int option, int argc, char *argv[])
+{
+    bool check = argc > 1;
+    bool ok = true;
+
+    if (!l_meta.size)
+        report(3, "Warning: Calling remove head on empty queue");
+    error_check();
+
+    element_t *re = NULL;
+    size_t len = 0;
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
+        re = option ? q_take_tail(l_meta.l, &len) : q_take_head(l_meta.l, &len);
+        lat_end(option ? LAT_REMOVE_TAIL : LAT_REMOVE_HEAD, t0);
+    }
+    exception_cancel();
+
+    if (re) {
+        if (!re->value) {
+            report(1, "ERROR: Removed element holds no value");
+            ok = false;
+        } else if (strlen(re->value) != len) {
+            report(1, "ERROR: Removed value has length %zu, reported %zu",
+                   strlen(re->value), len);
+            ok = false;
+        } else {
+            report(2, "Removed %.*s from queue", string_length, re->value);
+        }
+        if (ok && check && strncmp(re->value, argv[1], string_length)) {
+            report(1, "ERROR: Removed value %.*s != expected value %.*s",
+                   string_length, re->value, string_length, argv[1]);
+            ok = false;
+        }
+        q_release_element(re);
+        lcnt--;
+        l_meta.size--;
+    } else {
+        fail_count++;
+        if (!check && fail_count < fail_limit) {
+            report(2, "Removal from queue failed");
+        } else {
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_remove(int option, int argc, char *argv[])
 {
     // option 0 is for remove head; option 1 is for remove tail
@@ -344,6 +676,9 @@ static bool do_remove(int option, int argc, char *argv[])
         return false;
     }
 
+    if (zerocopy)
+        return do_take(option, argc, argv);
+
     char *removes = malloc(string_length + STRINGPAD + 1);
     if (!removes) {
         report(1,
@@ -375,9 +710,12 @@ static bool do_remove(int option, int argc, char *argv[])
     error_check();
 
     element_t *re = NULL;
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         re = option ? q_remove_tail(l_meta.l, removes, string_length + 1)
                     : q_remove_head(l_meta.l, removes, string_length + 1);
+        lat_end(option ? LAT_REMOVE_TAIL : LAT_REMOVE_HEAD, t0);
+    }
     exception_cancel();
 
     bool is_null = re ? false : true;
@@ -459,8 +797,11 @@ static bool do_rhq(int argc, char *argv[])
 
     element_t *re = NULL;
 
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         re = q_remove_head(l_meta.l, NULL, 0);
+        lat_end(LAT_REMOVE_HEAD, t0);
+    }
     exception_cancel();
 
     if (re) {
@@ -485,17 +826,129 @@ static bool do_rhq(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Element along with its position in queue */
+typedef struct {
+    element_t *e;
+    size_t pos;
+} element_pos_t;
+
+static int cmp_value(const void *a, const void *b)
+{
+    const element_pos_t *x = a, *y = b;
+    int r = strcmp(x->e->value, y->e->value);
+    return r ? r : (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/*
+ * Delete duplicates of unsorted queue with q_delete_dup_unsorted, then check
+ * that exactly the elements with unique strings remain, in their original
+ * order.
+ */
+static bool dedup_unsorted()
+{
+    if (!l_meta.l)
+        report(3, "Warning: Calling delete duplicate on null queue");
+    error_check();
+
+    size_t n = l_meta.l ? q_size(l_meta.l) : 0;
+    element_pos_t *sorted = malloc(n * sizeof(element_pos_t) + 1);
+    element_t **kept = malloc(n * sizeof(element_t *) + 1);
+    bool *dup = malloc(n * sizeof(bool) + 1);
+    if (!sorted || !kept || !dup) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for elements");
+        free(sorted);
+        free(kept);
+        free(dup);
+        return false;
+    }
+
+    size_t i = 0;
+    element_t *item;
+    if (l_meta.l) {
+        q_link(l_meta.l);
+        list_for_each_entry (item, l_meta.l, list) {
+            if (i == n)
+                break;
+            sorted[i].e = item;
+            sorted[i].pos = i;
+            dup[i++] = false;
+        }
+    }
+    n = i;
+
+    qsort(sorted, n, sizeof(element_pos_t), cmp_value);
+    for (i = 0; i + 1 < n; i++) {
+        if (!strcmp(sorted[i].e->value, sorted[i + 1].e->value))
+            dup[sorted[i].pos] = dup[sorted[i + 1].pos] = true;
+    }
+    size_t nkept = 0;
+    for (i = 0; i < n; i++) {
+        if (!dup[sorted[i].pos])
+            kept[sorted[i].pos] = sorted[i].e;
+    }
+    for (i = 0; i < n; i++) {
+        if (!dup[i])
+            kept[nkept++] = kept[i];
+    }
+    free(sorted);
+    free(dup);
+
+    bool ok = true;
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
+        ok = q_delete_dup_unsorted(l_meta.l);
+        lat_end(LAT_DELETE_DUP, t0);
+    }
+    exception_cancel();
+
+    if (!ok) {
+        report(1, l_meta.l ? "ERROR: Delete duplicate failed"
+                           : "ERROR: Calling delete duplicate on null queue");
+        free(kept);
+        return false;
+    }
+
+    i = 0;
+    list_for_each_entry (item, l_meta.l, list) {
+        if (i == nkept || item != kept[i]) {
+            report(1, "ERROR: Kept wrong elements or changed their order");
+            ok = false;
+            break;
+        }
+        i++;
+    }
+    if (ok && i != nkept) {
+        report(1, "ERROR: Deleted element having unique string");
+        ok = false;
+    }
+    lcnt = nkept;
+    l_meta.size = nkept;
+    free(kept);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
+    if (argc == 2 && !strcmp(argv[1], "hash"))
+        return dedup_unsorted();
+
     if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+        report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
     }
 
+    if (simulation)
+        return complexity_verdict(is_delete_dup_linear(), "O(N)");
+
     bool ok = true;
     // set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         ok = q_delete_dup(l_meta.l);
+        lat_end(LAT_DELETE_DUP, t0);
+    }
     exception_cancel();
 
     // set_noallocate_mode(false);
@@ -533,13 +986,49 @@ static bool do_reverse(int argc, char *argv[])
         return false;
     }
 
+    if (simulation)
+        return complexity_verdict(is_reverse_linear(), "O(N)");
+
     if (!l_meta.l)
         report(3, "Warning: Calling reverse on null queue");
     error_check();
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         q_reverse(l_meta.l);
+        lat_end(LAT_REVERSE, t0);
+    }
+    exception_cancel();
+
+    set_noallocate_mode(false);
+    show_queue(3);
+    return !error_check();
+}
+
+static bool do_reverseK(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int k;
+    if (!get_int(argv[1], &k) || k < 1) {
+        report(1, "Invalid group size '%s'", argv[1]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling reverseK on null queue");
+    error_check();
+
+    set_noallocate_mode(true);
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
+        q_reverseK(l_meta.l, k);
+        lat_end(LAT_REVERSEK, t0);
+    }
     exception_cancel();
 
     set_noallocate_mode(false);
@@ -549,6 +1038,20 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_size_const();
+        if (!ok) {
+            report(1, "ERROR: Probably not constant time");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -574,7 +1077,9 @@ static bool do_size(int argc, char *argv[])
 
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
+            int64_t t0 = lat_begin();
             cnt = q_size(l_meta.l);
+            lat_end(LAT_SIZE, t0);
             ok = ok && !error_check();
         }
     }
@@ -596,13 +1101,41 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Sorting algorithms selectable by the argument of sort */
+static const struct {
+    char *name;
+    void (*sort)(struct list_head *head);
+    /* Whether it may allocate temporary storage */
+    bool allocates;
+} sort_algos[] = {
+    {"merge", q_sort, false},
+    {"prefix", q_sort_prefix, true},
+    {"radix", q_radix_sort, false},
+    {"natural", q_natural_sort, false},
+};
+
 bool do_sort(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
     }
 
+    int algo = 0;
+    if (argc == 2) {
+        int n = sizeof(sort_algos) / sizeof(sort_algos[0]);
+        while (algo < n && strcmp(argv[1], sort_algos[algo].name))
+            algo++;
+        if (algo == n) {
+            report(1, "Unknown sorting algorithm '%s'", argv[1]);
+            return false;
+        }
+    }
+
+    if (simulation)
+        return complexity_verdict(is_sort_n_log_n(sort_algos[algo].sort),
+                                  "O(N log N)");
+
     if (!l_meta.l)
         report(3, "Warning: Calling sort on null queue");
     error_check();
@@ -612,9 +1145,12 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
-    set_noallocate_mode(true);
-    if (exception_setup(true))
-        q_sort(l_meta.l);
+    set_noallocate_mode(!sort_algos[algo].allocates);
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
+        sort_algos[algo].sort(l_meta.l);
+        lat_end(LAT_SORT, t0);
+    }
     exception_cancel();
     set_noallocate_mode(false);
 
@@ -639,6 +1175,74 @@ bool do_sort(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_merge(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling merge on null queue");
+    error_check();
+
+    /* The current queue goes first, receiving all the elements */
+    queue_store();
+    list_move(&current->ctx.chain, &queue_chain);
+    /* dedup leaves lcnt as it was, so count what the queues really hold */
+    size_t expected = 0;
+    named_queue_t *nq;
+    list_for_each_entry (nq, &queue_chain, ctx.chain) {
+        if (nq->ctx.q)
+            expected += q_size(nq->ctx.q);
+    }
+
+    int len = -1;
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
+        len = q_merge(&queue_chain);
+        lat_end(LAT_MERGE, t0);
+    }
+    exception_cancel();
+
+    bool ok = true;
+    list_for_each_entry (nq, &queue_chain, ctx.chain) {
+        /* Nothing is merged into a null queue */
+        if (!nq->ctx.q || !current->ctx.q)
+            continue;
+        if (nq != current && nq->ctx.size) {
+            report(1, "ERROR: Queue '%s' still holds %d elements", nq->name,
+                   nq->ctx.size);
+            ok = false;
+        }
+        nq->lcnt = nq == current ? expected : 0;
+    }
+    queue_load(current);
+
+    if (l_meta.l && len != (int) expected) {
+        report(1, "ERROR: Merged queue has %d elements, but %zu were expected",
+               len, expected);
+        ok = false;
+    }
+    if (ok && l_meta.l && l_meta.size > 1) {
+        q_link(l_meta.l);
+        for (struct list_head *cur_l = l_meta.l->next;
+             cur_l->next != l_meta.l; cur_l = cur_l->next) {
+            element_t *item, *next_item;
+            item = list_entry(cur_l, element_t, list);
+            next_item = list_entry(cur_l->next, element_t, list);
+            if (strcmp(item->value, next_item->value) > 0) {
+                report(1, "ERROR: Not sorted in ascending order");
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_dm(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -651,10 +1255,18 @@ static bool do_dm(int argc, char *argv[])
     error_check();
 
     bool ok = true;
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         ok = q_delete_mid(l_meta.l);
+        lat_end(LAT_DELETE_MID, t0);
+    }
     exception_cancel();
 
+    if (ok && lcnt) {
+        lcnt--;
+        l_meta.size--;
+    }
+
     show_queue(3);
     return ok && !error_check();
 }
@@ -666,13 +1278,19 @@ static bool do_swap(int argc, char *argv[])
         return false;
     }
 
+    if (simulation)
+        return complexity_verdict(is_swap_linear(), "O(N)");
+
     if (!l_meta.l)
         report(3, "Warning: Try to access null queue");
     error_check();
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        int64_t t0 = lat_begin();
         q_swap(l_meta.l);
+        lat_end(LAT_SWAP, t0);
+    }
     exception_cancel();
 
     set_noallocate_mode(false);
@@ -681,22 +1299,268 @@ static bool do_swap(int argc, char *argv[])
     return !error_check();
 }
 
-void q_shuffle(struct list_head *head)
+static bool do_stats(int argc, char *argv[])
+{
+    if (argc == 1) {
+        lat_report();
+        return true;
+    }
+    if (argc == 2 && !strcmp(argv[1], "reset")) {
+        lat_reset();
+        return true;
+    }
+    if (argc == 3 && !strcmp(argv[1], "csv")) {
+        FILE *fp = fopen(argv[2], "w");
+        if (!fp) {
+            report(1, "ERROR: Could not open %s: %s", argv[2], strerror(errno));
+            return false;
+        }
+        bool ok = lat_dump_csv(fp);
+        ok = !fclose(fp) && ok;
+        if (!ok)
+            report(1, "ERROR: Could not write %s", argv[2]);
+        return ok;
+    }
+    report(1, "%s takes no arguments, reset, or csv with a file name",
+           argv[0]);
+    return false;
+}
+
+static bool do_memstat(int argc, char *argv[])
 {
-    if (!head || list_empty(head) || list_is_singular(head))
+    if (argc == 1) {
+        mem_report();
+        return true;
+    }
+    if (argc == 2 && !strcmp(argv[1], "reset")) {
+        mem_reset();
+        return true;
+    }
+    report(1, "%s takes no arguments or reset", argv[0]);
+    return false;
+}
+
+/* Run after every command, reports the allocations of its queue calls */
+static bool memstat_command(int argc, char *argv[])
+{
+    mem_command_done(memstat_line ? argv[0] : NULL);
+    return true;
+}
+
+/*
+ * Benchmark of the concurrent queue.
+ * Producers insert their share of the elements while consumers remove them,
+ * until the producers are done and the queue is drained. One call out of
+ * BENCH_SAMPLE_EVERY is timed, in CPU cycles.
+ */
+#define BENCH_SAMPLE_EVERY 16
+
+typedef struct {
+    pthread_t thread;
+    bool spawned;
+    mpmc_t *q;
+    int tid;
+    size_t ops;        /* Elements to insert, for a producer */
+    size_t done;       /* Elements inserted or removed */
+    const char *value; /* String inserted by a producer */
+    int64_t *samples;
+    size_t nsamples, cap;
+} bench_worker_t;
+
+static bool bench_producers_done;
+
+static void *bench_producer(void *arg)
+{
+    bench_worker_t *w = arg;
+    for (size_t i = 0; i < w->ops; i++) {
+        bool timed = !(i % BENCH_SAMPLE_EVERY);
+        int64_t t0 = timed ? cpucycles() : 0;
+        if (!mpmc_insert_tail(w->q, w->tid, w->value))
+            break;
+        if (timed)
+            w->samples[w->nsamples++] = cpucycles() - t0;
+        w->done++;
+    }
+    return NULL;
+}
+
+static void *bench_consumer(void *arg)
+{
+    bench_worker_t *w = arg;
+    char buf[MAX_RANDSTR_LEN + 1];
+    for (;;) {
+        bool timed = !(w->done % BENCH_SAMPLE_EVERY);
+        int64_t t0 = timed ? cpucycles() : 0;
+        if (mpmc_remove_head(w->q, w->tid, buf, sizeof(buf))) {
+            if (timed && w->nsamples < w->cap)
+                w->samples[w->nsamples++] = cpucycles() - t0;
+            w->done++;
+            continue;
+        }
+        /*
+         * Empty, and nothing more coming once producers are done. A last
+         * element may have been pushed between the failed remove and the
+         * check, so take it and count it before concluding.
+         */
+        if (__atomic_load_n(&bench_producers_done, __ATOMIC_ACQUIRE)) {
+            if (!mpmc_remove_head(w->q, w->tid, buf, sizeof(buf)))
+                break;
+            w->done++;
+            continue;
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+static int cmp_cycles(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Gather the samples of n workers, sort them and take two quantiles */
+static void bench_quantiles(bench_worker_t *w,
+                            int n,
+                            int64_t *buf,
+                            int64_t *p50,
+                            int64_t *p99)
+{
+    size_t cnt = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(buf + cnt, w[i].samples, w[i].nsamples * sizeof(int64_t));
+        cnt += w[i].nsamples;
+    }
+    if (!cnt) {
+        *p50 = *p99 = 0;
         return;
-    srand(time(0));
-    int len = q_size(head);
-    struct list_head *tail = head, *node = NULL;
-    for (; len > 1; len--) {
-        node = head->next;
-        for (int i = rand() % len; i > 0; i--) {
-            node = node->next;
+    }
+    qsort(buf, cnt, sizeof(int64_t), cmp_cycles);
+    *p50 = buf[cnt / 2];
+    *p99 = buf[cnt * 99 / 100];
+}
+
+/* Run one round with np producers and nc consumers passing ops elements */
+static bool bench_mpmc_round(int np, int nc, size_t ops)
+{
+    int n = np + nc;
+    /* Nobody knows how many elements a consumer gets, so any may get all */
+    size_t cap = ops / BENCH_SAMPLE_EVERY + 1;
+    size_t nsamples = cap * (nc + 1) + np;
+    bench_worker_t *w = calloc(n, sizeof(bench_worker_t));
+    int64_t *samples = malloc(nsamples * sizeof(int64_t));
+    int64_t *sorted = malloc((cap + n) * sizeof(int64_t));
+    char *values = malloc(np * (MAX_RANDSTR_LEN + 1));
+    mpmc_t *q = mpmc_new(n);
+    bool ok = w && samples && sorted && values && q;
+    if (!ok) {
+        report(1, "ERROR: Could not allocate benchmark");
+        goto out;
+    }
+
+    int64_t *next = samples;
+    for (int i = 0; i < n; i++) {
+        w[i].q = q;
+        w[i].tid = i;
+        if (i < np) {
+            char *value = values + i * (MAX_RANDSTR_LEN + 1);
+            fill_rand_string(value, MAX_RANDSTR_LEN + 1);
+            w[i].value = value;
+            w[i].ops = ops / np + (i < ops % np);
+            w[i].cap = w[i].ops / BENCH_SAMPLE_EVERY + 1;
+        } else {
+            w[i].cap = cap;
         }
-        list_del(node);
-        list_add(node, tail->prev);
-        tail = node;
+        w[i].samples = next;
+        next += w[i].cap;
+    }
+
+    /* Signals go to the main thread, see run_jobs in queue.c */
+    sigset_t all, old;
+    sigfillset(&all);
+    bench_producers_done = false;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = n - 1; i >= 0; i--) {
+        w[i].spawned = !pthread_create(&w[i].thread, NULL,
+                                       i < np ? bench_producer : bench_consumer,
+                                       &w[i]);
+        ok = ok && w[i].spawned;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    for (int i = 0; i < np; i++) {
+        if (w[i].spawned)
+            pthread_join(w[i].thread, NULL);
     }
+    __atomic_store_n(&bench_producers_done, true, __ATOMIC_RELEASE);
+    for (int i = np; i < n; i++) {
+        if (w[i].spawned)
+            pthread_join(w[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!ok) {
+        report(1, "ERROR: Could not start %d threads", n);
+        goto out;
+    }
+
+    size_t inserted = 0, removed = 0;
+    for (int i = 0; i < n; i++)
+        *(i < np ? &inserted : &removed) += w[i].done;
+    if (inserted != ops || removed != ops) {
+        report(1, "ERROR: Inserted %zu and removed %zu of %zu elements",
+               inserted, removed, ops);
+        ok = false;
+        goto out;
+    }
+
+    double secs =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    int64_t ins50, ins99, rem50, rem99;
+    bench_quantiles(w, np, sorted, &ins50, &ins99);
+    bench_quantiles(w + np, nc, sorted, &rem50, &rem99);
+    report(1, "%9d %9d %10zu %10.2f %8ld %8ld %8ld %8ld", np, nc, ops,
+           secs > 0 ? ops / secs * 1e-6 : 0.0, (long) ins50, (long) ins99,
+           (long) rem50, (long) rem99);
+
+out:
+    mpmc_free(q);
+    free(values);
+    free(sorted);
+    free(samples);
+    free(w);
+    return ok;
+}
+
+static bool do_bench(int argc, char *argv[])
+{
+    int np, nc, ops;
+    if (argc != 5 || strcmp(argv[1], "mpmc")) {
+        report(1, "%s takes mpmc and the numbers of producers, consumers "
+               "and elements", argv[0]);
+        return false;
+    }
+    if (!get_int(argv[2], &np) || !get_int(argv[3], &nc) ||
+        !get_int(argv[4], &ops) || np < 1 || nc < 1 || ops < 1 ||
+        np + nc > MPMC_MAX_THREADS) {
+        report(1, "Invalid benchmark, at most %d threads in total",
+               MPMC_MAX_THREADS);
+        return false;
+    }
+
+    /* Simulated failures would make the rounds incomparable */
+    int saved_probability = fail_probability;
+    fail_probability = 0;
+    report(1, "%9s %9s %10s %10s %8s %8s %8s %8s", "producers",
+           "consumers", "elements", "Melem/s", "ins p50", "ins p99",
+           "rem p50", "rem p99");
+    bool ok = true;
+    int most = np > nc ? np : nc;
+    for (int t = 1; ok && t < most; t *= 2)
+        ok = bench_mpmc_round(t < np ? t : np, t < nc ? t : nc, ops);
+    ok = ok && bench_mpmc_round(np, nc, ops);
+    fail_probability = saved_probability;
+    return ok && !error_check();
 }
 
 static bool do_shuffle(int argc, char *argv[])
@@ -710,15 +1574,20 @@ static bool do_shuffle(int argc, char *argv[])
         report(3, "Warning: Try to access null queue");
     error_check();
 
+    bool ok = true;
     set_noallocate_mode(true);
+    q_link(l_meta.l);
     if (exception_setup(true))
-        q_shuffle(l_meta.l);
+        ok = q_shuffle(l_meta.l);
     exception_cancel();
 
     set_noallocate_mode(false);
+    if (!ok)
+        report(1, "ERROR: Could not allocate %d nodes to shuffle",
+               q_size(l_meta.l));
 
     show_queue(3);
-    return !error_check();
+    return ok && !error_check();
 }
 
 static bool is_circular()
@@ -751,6 +1620,7 @@ static bool show_queue(int vlevel)
         return true;
     }
 
+    q_link(l_meta.l);
     if (!is_circular()) {
         report(vlevel, "ERROR:  Queue is not doubly circular");
         return false;
@@ -792,19 +1662,314 @@ static bool show_queue(int vlevel)
     return ok;
 }
 
+/* Buffer of dump_queue, written out whenever it fills up */
+#define DUMP_BUFSIZE (1 << 16)
+static char dump_buf[DUMP_BUFSIZE];
+
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Header of a queue snapshot, written by save and read by load. It is
+ * followed by count records of bytes in total, each holding the length of a
+ * string as uint32_t, the string and its null terminator. Numbers are in host
+ * byte order.
+ */
+#define SNAPSHOT_MAGIC "QSN1"
+
+typedef struct {
+    char magic[4];
+    uint32_t count;
+    uint64_t bytes;
+} snapshot_header_t;
+
+/* Append n bytes to the buffer of dump_queue, writing it out when full */
+static bool dump_put(int fd, size_t *used, const void *p, size_t n)
+{
+    if (*used + n > DUMP_BUFSIZE) {
+        if (!write_all(fd, dump_buf, *used))
+            return false;
+        *used = 0;
+        /* Too long to buffer */
+        if (n > DUMP_BUFSIZE)
+            return write_all(fd, p, n);
+    }
+    memcpy(dump_buf + *used, p, n);
+    *used += n;
+    return true;
+}
+
+/*
+ * Write every element of the queue to fd, one per line, or as the records of
+ * a snapshot. The number of elements goes to *cntp, the number of bytes
+ * written to *bytesp.
+ */
+static bool dump_queue(int fd, bool snapshot, int *cntp, uint64_t *bytesp)
+{
+    struct list_head *ori = l_meta.l;
+    struct list_head *cur = l_meta.l->next;
+    size_t used = 0;
+    uint64_t bytes = 0;
+    int cnt = 0;
+    bool ok = true;
+
+    if (exception_setup(false)) {
+        while (ok && ori != cur && cnt < lcnt) {
+            const element_t *e = list_entry(cur, element_t, list);
+            if (snapshot) {
+                uint32_t len = e->len;
+                ok = dump_put(fd, &used, &len, sizeof(len)) &&
+                     dump_put(fd, &used, e->value, len + 1);
+                bytes += sizeof(len) + len + 1;
+            } else {
+                size_t len = strlen(e->value);
+                ok = dump_put(fd, &used, e->value, len) &&
+                     dump_put(fd, &used, "\n", 1);
+                bytes += len + 1;
+            }
+            cnt++;
+            cur = cur->next;
+        }
+        ok = ok && write_all(fd, dump_buf, used);
+    }
+    exception_cancel();
+
+    *cntp = cnt;
+    *bytesp = bytes;
+    if (ok && cur != ori) {
+        report(1, "ERROR:  Queue has more than %d elements", lcnt);
+        ok = false;
+    }
+    return ok && !error_check();
+}
+
 static bool do_show(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    if (argc == 1)
+        return show_queue(0);
+    if (argc != 2) {
+        report(1, "%s takes no arguments or a file name", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l) {
+        report(1, "Warning: Calling show on null queue");
         return false;
     }
-    return show_queue(0);
+    q_link(l_meta.l);
+    if (!is_circular()) {
+        report(1, "ERROR:  Queue is not doubly circular");
+        return false;
+    }
+
+    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        report(1, "Couldn't open file '%s'", argv[1]);
+        return false;
+    }
+    int cnt;
+    uint64_t bytes;
+    bool ok = dump_queue(fd, false, &cnt, &bytes);
+    ok = !close(fd) && ok;
+    if (ok)
+        report(2, "Wrote %d elements to '%s'", cnt, argv[1]);
+    else
+        report(1, "Couldn't write queue to '%s'", argv[1]);
+    return ok;
+}
+
+static bool do_save(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s takes a file name", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l) {
+        report(1, "Warning: Calling save on null queue");
+        return false;
+    }
+    q_link(l_meta.l);
+    if (!is_circular()) {
+        report(1, "ERROR:  Queue is not doubly circular");
+        return false;
+    }
+
+    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        report(1, "Couldn't open file '%s'", argv[1]);
+        return false;
+    }
+    /* The header is filled in once the records are written */
+    snapshot_header_t hdr = {.count = 0};
+    int cnt = 0;
+    bool ok = lseek(fd, sizeof(hdr), SEEK_SET) == sizeof(hdr) &&
+              dump_queue(fd, true, &cnt, &hdr.bytes);
+    if (ok) {
+        memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+        hdr.count = cnt;
+        ok = pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr);
+    }
+    ok = !close(fd) && ok;
+    if (ok)
+        report(2, "Saved %d elements to '%s'", cnt, argv[1]);
+    else
+        report(1, "Couldn't save queue to '%s'", argv[1]);
+    return ok;
+}
+
+/*
+ * Point sv at the strings of a snapshot mapped at map, of size bytes.
+ * Return the number of strings, or -1 if the snapshot is malformed.
+ */
+static int snapshot_strings(const char *map, size_t size, char ***svp)
+{
+    snapshot_header_t hdr;
+    if (size < sizeof(hdr))
+        return -1;
+    memcpy(&hdr, map, sizeof(hdr));
+    if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) ||
+        hdr.bytes != size - sizeof(hdr) || hdr.count > INT_MAX)
+        return -1;
+
+    char **sv = malloc((hdr.count + 1) * sizeof(char *));
+    if (!sv)
+        return -1;
+    const char *p = map + sizeof(hdr), *end = map + size;
+    uint32_t i;
+    for (i = 0; i < hdr.count; i++) {
+        uint32_t len;
+        if (end - p < sizeof(len))
+            break;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if (end - p <= len || p[len]) {
+            p = NULL;
+            break;
+        }
+        sv[i] = (char *) p;
+        p += len + 1;
+    }
+    /* Records must end exactly with the file, and there must be count */
+    if (i != hdr.count || p != end) {
+        free(sv);
+        return -1;
+    }
+    *svp = sv;
+    return hdr.count;
+}
+
+static bool do_load(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s takes a file name", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l) {
+        report(1, "Warning: Calling load on null queue");
+        return false;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        report(1, "Couldn't open file '%s'", argv[1]);
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "Couldn't map file '%s'", argv[1]);
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    char **sv = NULL;
+    int cnt = snapshot_strings(map, st.st_size, &sv);
+    if (cnt < 0) {
+        report(1, "ERROR: '%s' is not a valid snapshot", argv[1]);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    /* The strings are copied into a single batch, if they fit its slots */
+    bool ok = !cnt;
+    if (cnt) {
+        if (exception_setup(true)) {
+            mem_begin();
+            ok = q_insert_tail_bulk(l_meta.l, sv, cnt, cnt);
+            mem_end(LAT_INSERT_TAIL, ok ? cnt : 1);
+        }
+        exception_cancel();
+    }
+    free(sv);
+    munmap(map, st.st_size);
+
+    if (!ok) {
+        report(1, "ERROR: Could not load %d elements from '%s'", cnt,
+               argv[1]);
+        return false;
+    }
+    lcnt += cnt;
+    l_meta.size += cnt;
+    report(2, "Loaded %d elements from '%s'", cnt, argv[1]);
+    show_queue(3);
+    return !error_check();
+}
+
+static void pool_changed(int oldval)
+{
+    q_set_pool(pool_mode);
+}
+
+static void threads_changed(int oldval)
+{
+    q_set_sort_threads(sort_threads);
+}
+
+static void sim_threads_changed(int oldval)
+{
+    set_dudect_threads(sim_threads);
+}
+
+static void instrument_changed(int oldval)
+{
+    lat_enabled = instrument;
+}
+
+static void seed_changed(int oldval)
+{
+    prng_seed(seed);
 }
 
 static void console_init()
 {
-    ADD_COMMAND(new, "                | Create new queue");
-    ADD_COMMAND(free, "                | Delete queue");
+    ADD_COMMAND(new,
+                " [engine]       | Create new queue backed by engine "
+                "(list, ring; default: list)");
+    ADD_COMMAND(free,
+                "                | Delete queue. Leaks are checked once no "
+                "other queue is left");
+    ADD_COMMAND(switch,
+                " [name]         | Switch to queue name, creating it if "
+                "needed, or list the queues");
+    ADD_COMMAND(merge,
+                "                | Merge all sorted queues into the current "
+                "one");
     ADD_COMMAND(
         ih,
         " str [n]        | Insert string str at head of queue n times. "
@@ -825,22 +1990,60 @@ static void console_init()
         rhq,
         "                | Remove from head of queue without reporting value.");
     ADD_COMMAND(reverse, "                | Reverse queue");
-    ADD_COMMAND(sort, "                | Sort queue in ascending order");
+    ADD_COMMAND(reverseK,
+                " k              | Reverse the nodes of queue k at a time");
+    ADD_COMMAND(sort,
+                " [algo]         | Sort queue in ascending order with algo "
+                "(merge, prefix, radix, natural; default: merge)");
     ADD_COMMAND(
         size, " [n]            | Compute queue size n times (default: n == 1)");
-    ADD_COMMAND(show, "                | Show queue contents");
+    ADD_COMMAND(show,
+                " [file]         | Show queue contents, or write all of them "
+                "to file, one per line");
+    ADD_COMMAND(save,
+                " file           | Save queue to file as a binary snapshot");
+    ADD_COMMAND(load,
+                " file           | Insert the elements of a snapshot written "
+                "by save at tail of queue");
     ADD_COMMAND(dm, "                | Delete middle node in queue");
-    ADD_COMMAND(
-        dedup, "                | Delete all nodes that have duplicate string");
+    ADD_COMMAND(dedup,
+                " [hash]         | Delete all nodes that have duplicate string. "
+                "Queue needs not be sorted if hash is given");
     ADD_COMMAND(swap,
                 "                | Swap every two adjacent nodes in queue");
     ADD_COMMAND(shuffle, "		| Shuffle the queue randomly");
+    ADD_COMMAND(memstat,
+                " [reset]        | Show allocations per call of queue API "
+                "functions, or clear them");
+    ADD_COMMAND(bench,
+                " mpmc p c n     | Pass n elements from p producer to c "
+                "consumer threads through the concurrent queue, also with "
+                "fewer threads");
+    ADD_COMMAND(stats,
+                " [reset|csv f]  | Show latency of queue API calls, clear "
+                "them, or write them to file f as CSV");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("pool", &pool_mode, "Allocate elements from slab pool",
+              pool_changed);
+    add_param("threads", &sort_threads, "Number of threads used by sort",
+              threads_changed);
+    add_param("zerocopy", &zerocopy,
+              "Remove elements without copying their strings", NULL);
+    add_param("simthreads", &sim_threads,
+              "Number of threads measuring in simulation mode",
+              sim_threads_changed);
+    add_param("memstat", &memstat_line,
+              "Show allocations per call after every command", NULL);
+    add_param("instrument", &instrument,
+              "Record latency of queue API calls in CPU cycles",
+              instrument_changed);
+    add_param("seed", &seed, "Reseed the generator used by shuffle",
+              seed_changed);
 }
 
 /* Signal handlers */
@@ -855,7 +2058,7 @@ static void sigsegvhandler(int sig)
 
 static void sigalrmhandler(int sig)
 {
-    trigger_exception(
+    defer_exception(
         "Time limit exceeded.  Either you are in an infinite loop, or your "
         "code is too inefficient");
 }
@@ -864,6 +2067,11 @@ static void queue_init()
 {
     fail_count = 0;
     l_meta.l = NULL;
+    current = queue_find(DEFAULT_QUEUE);
+    if (!current) {
+        fprintf(stderr, "Could not allocate queue chain\n");
+        exit(1);
+    }
     signal(SIGSEGV, sigsegvhandler);
     signal(SIGALRM, sigalrmhandler);
 }
@@ -871,13 +2079,21 @@ static void queue_init()
 static bool queue_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (lcnt > big_list_size)
-        set_cautious_mode(false);
-
-    if (exception_setup(true))
-        q_free(l_meta.l);
-    exception_cancel();
-    set_cautious_mode(true);
+    queue_store();
+    named_queue_t *nq, *safe;
+    list_for_each_entry_safe (nq, safe, &queue_chain, ctx.chain) {
+        if (exception_setup(true)) {
+            int64_t t0 = lat_begin();
+            q_free(nq->ctx.q);
+            lat_end(LAT_FREE, t0);
+        }
+        exception_cancel();
+        list_del(&nq->ctx.chain);
+        free(nq->name);
+        free(nq);
+    }
+    current = NULL;
+    l_meta.l = NULL;
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -891,11 +2107,12 @@ static bool queue_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE][-c CFILE]\n", cmd);
     printf("\t-h         Print this information\n");
-    printf("\t-f IFILE   Read commands from IFILE\n");
+    printf("\t-f IFILE   Read commands from IFILE, text or binary trace\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
+    printf("\t-c CFILE   Compile IFILE into binary trace CFILE and exit\n");
     exit(0);
 }
 
@@ -944,10 +2161,12 @@ int main(int argc, char *argv[])
     char *infile_name = NULL;
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
+    char cbuf[BUFSIZE];
+    char *compile_name = NULL;
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:l:c:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -972,6 +2191,11 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 'c':
+            strncpy(cbuf, optarg, BUFSIZE);
+            cbuf[BUFSIZE - 1] = '\0';
+            compile_name = cbuf;
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -980,10 +2204,19 @@ int main(int argc, char *argv[])
     }
 
     srand((unsigned int) (time(NULL)));
+    prng_seed(time(NULL));
     queue_init();
     init_cmd();
     console_init();
 
+    if (compile_name) {
+        if (!infile_name) {
+            fprintf(stderr, "No input file given to compile\n");
+            exit(EXIT_FAILURE);
+        }
+        return compile_trace(infile_name, compile_name) ? 0 : 1;
+    }
+
     /* Trigger call back function(auto completion) */
     linenoiseSetCompletionCallback(completion);
 
@@ -997,6 +2230,7 @@ int main(int argc, char *argv[])
         set_logfile(logfile_name);
 
     add_quit_helper(queue_quit);
+    set_post_cmd_hook(memstat_command);
 
     bool ok = true;
     ok = ok && run_console(infile_name);
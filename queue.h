@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "list.h"
 
 /* Linked list element */
@@ -19,8 +20,24 @@ typedef struct {
      */
     char *value;
     struct list_head list;
+    /* Length and FNV-1a hash of value, set when the element is created */
+    uint32_t len : 31;
+    /* Set if the element and its string sit in a slot of the pool */
+    uint32_t pooled : 1;
+    uint32_t hash;
 } element_t;
 
+/*
+ * Context of a queue in a chain of queues, as handed to q_merge.
+ * q points to the queue, chain links the contexts together and size holds
+ * the number of elements of q.
+ */
+typedef struct {
+    struct list_head *q;
+    struct list_head chain;
+    int size;
+} queue_context_t;
+
 /* Operations on queue */
 
 /*
@@ -29,6 +46,29 @@ typedef struct {
  */
 struct list_head *q_new();
 
+/*
+ * Create empty queue backed by a ring buffer.
+ * Elements are kept in a circular array, which makes insertion and removal at
+ * both ends and q_reverse cheap. Every other operation on the queue works as
+ * well, at the cost of linking the elements into the list first.
+ * Return NULL if could not allocate space.
+ */
+struct list_head *q_new_ring();
+
+/*
+ * Link the elements of a ring buffer queue into its list_head, so that the
+ * list can be walked directly. Needed before touching the list of a queue
+ * created by q_new_ring; no effect on other queues or if head is NULL.
+ */
+void q_link(struct list_head *head);
+
+/*
+ * Return the element at head (tail) of queue without removing it.
+ * Return NULL if queue is NULL or empty.
+ */
+element_t *q_peek_head(struct list_head *head);
+element_t *q_peek_tail(struct list_head *head);
+
 /*
  * Free ALL storage used by queue.
  * No effect if q is NULL
@@ -53,6 +93,24 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/*
+ * Attempt to insert n elements at head of queue at once.
+ * The i-th element inserted holds a copy of sv[i % nstr], i.e. nstr == n
+ * inserts an array of strings, nstr == 1 inserts one string n times. The
+ * resulting queue is the same as calling q_insert_head for each element in
+ * turn, but all elements are allocated in one batch and spliced in together.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space, in which case no
+ * element is inserted.
+ */
+bool q_insert_head_bulk(struct list_head *head, char **sv, int nstr, int n);
+
+/*
+ * Attempt to insert n elements at tail of queue at once.
+ * Other attribute is as same as q_insert_head_bulk.
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **sv, int nstr, int n);
+
 /*
  * Attempt to remove element from head of queue.
  * Return target element.
@@ -75,6 +133,16 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/*
+ * Attempt to remove element from head (tail) of queue without copying.
+ * Return target element, whose value is handed over to the caller together
+ * with the element. If len is non-NULL, store the length of the string,
+ * excluding the null terminator, to *len.
+ * Return NULL if queue is NULL or empty.
+ */
+element_t *q_take_head(struct list_head *head, size_t *len);
+element_t *q_take_tail(struct list_head *head, size_t *len);
+
 /*
  * Attempt to release element.
  */
@@ -107,6 +175,15 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/*
+ * Delete all nodes that have duplicate string, like q_delete_dup, but
+ * without requiring the list to be sorted. Survivors keep their order.
+ * Runs in expected linear time using a temporary hash table.
+ * Return true if successful.
+ * Return false if list is NULL or the table could not be allocated.
+ */
+bool q_delete_dup_unsorted(struct list_head *head);
+
 /*
  * Attempt to swap every two adjacent nodes.
  *
@@ -123,6 +200,28 @@ void q_swap(struct list_head *head);
  */
 void q_reverse(struct list_head *head);
 
+/*
+ * Reverse the nodes of queue k at a time
+ * Nodes left over at the tail, fewer than k, keep their order.
+ * No effect if q is NULL or k is less than 2.
+ * Like q_reverse, only the existing nodes are rearranged.
+ *
+ * Ref: https://leetcode.com/problems/reverse-nodes-in-k-group/
+ */
+void q_reverseK(struct list_head *head, int k);
+
+/*
+ * Enable or disable pooled allocation of elements.
+ * In pooled mode, an element and its string are carved out of the same slot
+ * of a slab when the string is short enough, and slabs are returned as soon
+ * as all of their slots are released. Elements allocated in either mode can
+ * be released at any time, regardless of the mode currently set.
+ * The bulk insertions share one slab among the whole batch in pooled mode, so
+ * the slab lives on until every element of the batch is released. Otherwise
+ * they allocate each element on its own, as q_insert_head does.
+ */
+void q_set_pool(bool enable);
+
 /*
  * Sort elements of queue in ascending order
  * No effect if q is NULL or empty. In addition, if q has only one
@@ -130,4 +229,49 @@ void q_reverse(struct list_head *head);
  */
 void q_sort(struct list_head *head);
 
+/*
+ * Sort elements of queue in ascending order, like q_sort.
+ * The nodes are sorted in a temporary array by the first 8 bytes of their
+ * strings, and whole strings are only compared to break ties. Falls back to
+ * q_sort if the array could not be allocated.
+ */
+void q_sort_prefix(struct list_head *head);
+
+/*
+ * Sort elements of queue in ascending order, like q_sort.
+ * Performs a stable MSD radix sort directly on the list, switching to merge
+ * sort for small buckets. No memory is allocated.
+ */
+void q_radix_sort(struct list_head *head);
+
+/*
+ * Sort elements of queue in ascending order, like q_sort.
+ * Natural merge sort after Timsort: merges the runs already in the queue,
+ * reversing strictly descending ones first, and gallops through long
+ * stretches won by one side. A sorted or reverse sorted queue takes a single
+ * pass. No memory is allocated.
+ */
+void q_natural_sort(struct list_head *head);
+
+/*
+ * Merge every queue of the chain at head, each sorted in ascending order,
+ * into the queue of the first context, leaving the other queues empty.
+ * Queues are merged pairwise in the rounds of a tournament, which takes
+ * O(N log K) comparisons for N elements in K queues. Contexts whose q is NULL
+ * are skipped, the size of every context is updated.
+ * No memory is allocated, unless the first queue is backed by a ring buffer,
+ * whose array has to grow to hold all the elements.
+ * Return the number of elements in the merged queue, 0 if the first context
+ * holds no queue, or -1 if the array could not grow.
+ */
+int q_merge(struct list_head *head);
+
+/*
+ * Set the number of threads q_sort may use.
+ * Large queues are cut into runs which are sorted and merged by up to
+ * nthreads threads, small queues are always sorted serially.
+ * Values below 2 disable parallel sorting.
+ */
+void q_set_sort_threads(int nthreads);
+
 #endif /* LAB0_QUEUE_H */
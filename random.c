@@ -1,11 +1,16 @@
 #include "random.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* shameless stolen from ebacs */
-void randombytes(uint8_t *x, size_t how_much)
+static void urandombytes(uint8_t *x, size_t how_much)
 {
     ssize_t i;
     static int fd = -1;
@@ -37,3 +42,169 @@ void randombytes(uint8_t *x, size_t how_much)
         xlen -= i;
     }
 }
+
+/* Generator state, seeded with prng_seed(0) */
+static uint64_t prng_state[4] = {
+    0xe220a8397b1dcdafULL,
+    0x6e789e6aa1b965f4ULL,
+    0x06c45d188009454fULL,
+    0xf88bb8a8724c81ecULL,
+};
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+void prng_seed(uint64_t seed)
+{
+    /* Expand seed with splitmix64, which never yields an all-zero state */
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        prng_state[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t prng_next(void)
+{
+    uint64_t *s = prng_state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+uint64_t prng_below(uint64_t n)
+{
+    /* Reject the values that would make some results more likely */
+    uint64_t limit = -n % n;
+    uint64_t r;
+    do {
+        r = prng_next();
+    } while (r < limit);
+    return r % n;
+}
+
+/*
+ * Buffered random source behind randombytes. Each thread refills its own
+ * pool from four interleaved xoshiro256** generators, which are seeded from
+ * /dev/urandom on first use. The lanes are independent, so that a refill
+ * can be computed side by side.
+ */
+#define POOL_LANES 4
+#define POOL_WORDS 512
+
+typedef struct {
+    uint64_t s[4][POOL_LANES];
+    uint64_t words[POOL_WORDS];
+    size_t pos; /* Bytes of words already handed out */
+    bool seeded;
+    uint64_t bits; /* Unused bits for randombit */
+    int nbits;
+} random_pool_t;
+
+static __thread random_pool_t pool;
+
+static void pool_refill(random_pool_t *p)
+{
+    if (!p->seeded) {
+        urandombytes((uint8_t *) p->s, sizeof(p->s));
+        for (int j = 0; j < POOL_LANES; j++) {
+            /* xoshiro must not start from an all-zero state */
+            if (!(p->s[0][j] | p->s[1][j] | p->s[2][j] | p->s[3][j]))
+                p->s[0][j] = 1;
+        }
+        p->seeded = true;
+    }
+
+    uint64_t(*s)[POOL_LANES] = p->s;
+    for (int i = 0; i < POOL_WORDS; i += POOL_LANES) {
+        for (int j = 0; j < POOL_LANES; j++) {
+            p->words[i + j] = rotl(s[1][j] * 5, 7) * 9;
+            uint64_t t = s[1][j] << 17;
+            s[2][j] ^= s[0][j];
+            s[3][j] ^= s[1][j];
+            s[1][j] ^= s[2][j];
+            s[0][j] ^= s[3][j];
+            s[2][j] ^= t;
+            s[3][j] = rotl(s[3][j], 45);
+        }
+    }
+    p->pos = 0;
+}
+
+void randombytes(uint8_t *x, size_t xlen)
+{
+    random_pool_t *p = &pool;
+    while (xlen > 0) {
+        if (!p->seeded || p->pos == sizeof(p->words))
+            pool_refill(p);
+        size_t n = sizeof(p->words) - p->pos;
+        if (n > xlen)
+            n = xlen;
+        memcpy(x, (uint8_t *) p->words + p->pos, n);
+        p->pos += n;
+        x += n;
+        xlen -= n;
+    }
+}
+
+uint8_t randombit(void)
+{
+    random_pool_t *p = &pool;
+    if (!p->nbits) {
+        randombytes((uint8_t *) &p->bits, sizeof(p->bits));
+        p->nbits = 64;
+    }
+    uint8_t ret = p->bits & 1;
+    p->bits >>= 1;
+    p->nbits--;
+    return ret;
+}
+
+void randomchars(char *x, size_t len, const char *charset, size_t n)
+{
+    assert(n > 0 && n <= 256);
+    bool range = true;
+    for (size_t k = 1; k < n && range; k++)
+        range = charset[k] == charset[0] + (char) k;
+
+    /*
+     * Scale 16 random bits into [0, n) for every character, rather than
+     * reducing them modulo n
+     */
+    uint16_t r[256];
+    while (len > 0) {
+        size_t chunk = len < 256 ? len : 256;
+        randombytes((uint8_t *) r, chunk * sizeof(r[0]));
+        size_t i = 0;
+#ifdef __SSE2__
+        if (range) {
+            /* For a run of consecutive characters, first one plus index */
+            const __m128i mul = _mm_set1_epi16(n);
+            const __m128i base = _mm_set1_epi8(charset[0]);
+            for (; i + 16 <= chunk; i += 16) {
+                __m128i lo = _mm_mulhi_epu16(
+                    _mm_loadu_si128((const __m128i *) (r + i)), mul);
+                __m128i hi = _mm_mulhi_epu16(
+                    _mm_loadu_si128((const __m128i *) (r + i + 8)), mul);
+                __m128i v = _mm_add_epi8(_mm_packus_epi16(lo, hi), base);
+                _mm_storeu_si128((__m128i *) (x + i), v);
+            }
+        }
+#endif
+        for (; i < chunk; i++)
+            x[i] = charset[(r[i] * n) >> 16];
+        x += chunk;
+        len -= chunk;
+    }
+}
@@ -4,13 +4,22 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Fill x with xlen random bytes from a buffered pool of the calling thread */
 void randombytes(uint8_t *x, size_t xlen);
 
-static inline uint8_t randombit(void)
-{
-    uint8_t ret = 0;
-    randombytes(&ret, 1);
-    return ret & 1;
-}
+/* Random bit, taken from the pool 64 at a time */
+uint8_t randombit(void);
+
+/* Fill x with len characters picked at random from the first n of charset */
+void randomchars(char *x, size_t len, const char *charset, size_t n);
+
+/* Seed the generator behind prng_next, for reproducible sequences */
+void prng_seed(uint64_t seed);
+
+/* Next output of a xoshiro256** generator */
+uint64_t prng_next(void);
+
+/* Uniformly distributed random number in [0, n), for n > 0 */
+uint64_t prng_below(uint64_t n);
 
 #endif
@@ -11,8 +11,6 @@
 
 #include "report.h"
 
-#define MAX(a, b) ((a) < (b) ? (b) : (a))
-
 static FILE *errfile = NULL;
 static FILE *verbfile = NULL;
 static FILE *logfile = NULL;
@@ -160,22 +158,72 @@ static void fail_fun(char *format, char *msg)
 /* Maximum number of megabytes that application can use (0 = unlimited) */
 static int mblimit = 0;
 
-/* Keeping track of memory allocation */
-static size_t allocate_cnt = 0;
-static size_t allocate_bytes = 0;
-static size_t free_cnt = 0;
-static size_t free_bytes = 0;
+static unsigned int next_shard = 0;
 
-/* Counters giving peak memory usage */
-static size_t peak_bytes = 0;
-static size_t last_peak_bytes = 0;
-static size_t current_bytes = 0;
+int thread_shard(void)
+{
+    static __thread int shard = -1;
+    if (shard < 0)
+        shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) %
+                COUNT_SHARDS;
+    return shard;
+}
+
+int thread_shards(void)
+{
+    unsigned int n = __atomic_load_n(&next_shard, __ATOMIC_RELAXED);
+    return n < COUNT_SHARDS ? n : COUNT_SHARDS;
+}
+
+/*
+ * Keeping track of memory allocation.
+ * Every thread counts into its own shard, so that the allocation functions
+ * below can be called from any thread without contending for the counters.
+ * A block may be freed by another thread than the one which allocated it,
+ * hence the bytes in use of a shard may go negative, but their sum may not.
+ */
+typedef struct {
+    size_t allocate_cnt;
+    size_t allocate_bytes;
+    size_t free_cnt;
+    size_t free_bytes;
+} __attribute__((aligned(COUNT_SHARD_ALIGN))) mem_shard_t;
+
+static mem_shard_t mem_shards[COUNT_SHARDS];
+
+/* Threads share a shard past COUNT_SHARDS of them, hence the atomics */
+static void count_allocate(size_t bytes)
+{
+    mem_shard_t *sh = &mem_shards[thread_shard()];
+    __atomic_add_fetch(&sh->allocate_cnt, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sh->allocate_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static void count_free(size_t bytes)
+{
+    mem_shard_t *sh = &mem_shards[thread_shard()];
+    __atomic_add_fetch(&sh->free_cnt, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sh->free_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static size_t current_bytes(void)
+{
+    size_t allocated = 0, freed = 0;
+    for (int i = 0, n = thread_shards(); i < n; i++) {
+        allocated +=
+            __atomic_load_n(&mem_shards[i].allocate_bytes, __ATOMIC_RELAXED);
+        freed += __atomic_load_n(&mem_shards[i].free_bytes, __ATOMIC_RELAXED);
+    }
+    return allocated - freed;
+}
 
 static void check_exceed(size_t new_bytes)
 {
+    if (mblimit <= 0)
+        return;
     size_t limit_bytes = (size_t) mblimit << 20;
-    size_t request_bytes = new_bytes + current_bytes;
-    if (mblimit > 0 && request_bytes > limit_bytes) {
+    size_t request_bytes = new_bytes + current_bytes();
+    if (request_bytes > limit_bytes) {
         report_event(MSG_FATAL,
                      "Exceeded memory limit of %u megabytes with %lu bytes",
                      mblimit, request_bytes);
@@ -192,11 +240,7 @@ void *malloc_or_fail(size_t bytes, char *fun_name)
         return NULL;
     }
 
-    allocate_cnt++;
-    allocate_bytes += bytes;
-    current_bytes += bytes;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_allocate(bytes);
 
     return p;
 }
@@ -211,11 +255,7 @@ void *calloc_or_fail(size_t cnt, size_t bytes, char *fun_name)
         return NULL;
     }
 
-    allocate_cnt++;
-    allocate_bytes += cnt * bytes;
-    current_bytes += cnt * bytes;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_allocate(cnt * bytes);
 
     return p;
 }
@@ -231,11 +271,7 @@ char *strsave_or_fail(char *s, char *fun_name)
     if (!ss)
         fail_fun("strsave failed in %s", fun_name);
 
-    allocate_cnt++;
-    allocate_bytes += len + 1;
-    current_bytes += len + 1;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_allocate(len + 1);
 
     return strncpy(ss, s, len + 1);
 }
@@ -247,9 +283,7 @@ void free_block(void *b, size_t bytes)
         report_event(MSG_ERROR, "Attempting to free null block");
     free(b);
 
-    free_cnt++;
-    free_bytes += bytes;
-    current_bytes -= bytes;
+    count_free(bytes);
 }
 
 /* Free array, as from calloc */
@@ -259,9 +293,7 @@ void free_array(void *b, size_t cnt, size_t bytes)
         report_event(MSG_ERROR, "Attempting to free null block");
     free(b);
 
-    free_cnt++;
-    free_bytes += cnt * bytes;
-    current_bytes -= cnt * bytes;
+    count_free(cnt * bytes);
 }
 
 /* Free string saved by strsave_or_fail */
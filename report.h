@@ -31,6 +31,19 @@ void report(int verblevel, char *fmt, ...);
 /* Like report, but without return character */
 void report_noreturn(int verblevel, char *fmt, ...);
 
+/*
+ * Counters updated by many threads are split into COUNT_SHARDS shards, each
+ * on a cache line of its own, and summed when read. A thread is handed its
+ * shard round robin the first time it asks, so that threads rarely share one.
+ */
+#define COUNT_SHARDS 64
+#define COUNT_SHARD_ALIGN 64
+
+int thread_shard(void);
+
+/* Number of shards handed out so far, the only ones worth summing */
+int thread_shards(void);
+
 /* Attempt to call malloc.  Fail when returns NULL */
 void *malloc_or_fail(size_t bytes, char *fun_name);
 
@@ -4,6 +4,7 @@ from __future__ import print_function
 import subprocess
 import sys
 import getopt
+import os
 
 
 
@@ -35,9 +36,29 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-pool",
+        19: "trace-19-perf",
+        20: "trace-20-sort",
+        21: "trace-21-dedup",
+        22: "trace-22-ring",
+        23: "trace-23-zerocopy",
+        24: "trace-24-free",
+        25: "trace-25-stats",
+        26: "trace-26-growth",
+        27: "trace-27-memstat",
+        28: "trace-28-show",
+        29: "trace-29-shuffle",
+        30: "trace-30-merge",
+        31: "trace-31-mpmc",
+        32: "trace-32-snapshot",
+        33: "trace-33-reverseK",
+        34: "trace-34-binary"
     }
 
+    # Traces compiled with -c and replayed, which must print the same as text
+    binaryTraces = {34}
+
     traceProbs = {
         1: "Trace-01",
         2: "Trace-02",
@@ -55,10 +76,27 @@ class Tracer:
         14: "Trace-14",
         15: "Trace-15",
         16: "Trace-16",
-        17: "Trace-17"
+        17: "Trace-17",
+        18: "Trace-18",
+        19: "Trace-19",
+        20: "Trace-20",
+        21: "Trace-21",
+        22: "Trace-22",
+        23: "Trace-23",
+        24: "Trace-24",
+        25: "Trace-25",
+        26: "Trace-26",
+        27: "Trace-27",
+        28: "Trace-28",
+        29: "Trace-29",
+        30: "Trace-30",
+        31: "Trace-31",
+        32: "Trace-32",
+        33: "Trace-33",
+        34: "Trace-34"
     }
 
-    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
+    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6]
 
     RED = '\033[91m'
     GREEN = '\033[92m'
@@ -87,6 +125,8 @@ class Tracer:
             self.printInColor("ERROR: No trace with id %d" % tid, self.RED)
             return False
         fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
+        if tid in self.binaryTraces:
+            return self.runBinaryTrace(fname)
         vname = "%d" % self.verbLevel
         clist = self.command + ["-v", vname, "-f", fname]
 
@@ -97,6 +137,35 @@ class Tracer:
             return False
         return retcode == 0
 
+    def capture(self, clist):
+        try:
+            # Leave stderr alone, where valgrind reports
+            p = subprocess.Popen(clist, stdout=subprocess.PIPE)
+        except Exception as e:
+            self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
+            return None, None
+        out = p.communicate()[0]
+        return p.returncode, out
+
+    def runBinaryTrace(self, fname):
+        bname = "/tmp/qtest.%d.qtb" % os.getpid()
+        # Show the queue after every command, so the runs have more to differ
+        code, text = self.capture(self.command + ["-v", "3", "-f", fname])
+        if code is None:
+            return False
+        if self.verbLevel > 0:
+            sys.stdout.write(text.decode(errors="replace"))
+            sys.stdout.flush()
+        ok = code == 0 and subprocess.call([self.qtest, "-f", fname, "-c", bname]) == 0
+        if ok:
+            code, replay = self.capture(self.command + ["-v", "3", "-f", bname])
+            ok = code == 0 and replay == text
+            if code is not None and replay != text:
+                self.printInColor("ERROR: Replay of '%s' differs from the text" % fname, self.RED)
+        if os.path.exists(bname):
+            os.remove(bname)
+        return ok
+
     def run(self, tid=0):
         scoreDict = {k: 0 for k in self.traceDict.keys()}
         print("---\tTrace\t\tPoints")
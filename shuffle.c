@@ -0,0 +1,34 @@
+#include "shuffle.h"
+#include <stdlib.h>
+#include "queue.h"
+#include "random.h"
+
+/* Fisher-Yates shuffle over an array of the nodes, relinked afterwards */
+bool q_shuffle(struct list_head *head)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return true;
+
+    int len = q_size(head);
+    struct list_head **nodes = malloc(len * sizeof(struct list_head *));
+    if (!nodes)
+        return false;
+
+    struct list_head *node;
+    int n = 0;
+    list_for_each (node, head)
+        nodes[n++] = node;
+
+    for (int i = len - 1; i > 0; i--) {
+        int j = prng_below(i + 1);
+        node = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = node;
+    }
+
+    INIT_LIST_HEAD(head);
+    for (int i = 0; i < len; i++)
+        list_add_tail(nodes[i], head);
+    free(nodes);
+    return true;
+}
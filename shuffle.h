@@ -0,0 +1,15 @@
+#ifndef LAB0_SHUFFLE_H
+#define LAB0_SHUFFLE_H
+
+#include <stdbool.h>
+#include "list.h"
+
+/*
+ * Shuffle the elements of queue uniformly at random, with the generator of
+ * prng_next. The nodes are gathered in a temporary array, which is not taken
+ * from the harness allocator. Return false, leaving the queue as it was, if
+ * the array could not be allocated.
+ */
+bool q_shuffle(struct list_head *head);
+
+#endif /* LAB0_SHUFFLE_H */
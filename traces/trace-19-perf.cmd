@@ -0,0 +1,18 @@
+# Test performance of delete_mid on a queue of 1M elements
+option fail 0
+option malloc 0
+new
+ih dolphin 500000
+it gerbil 500000
+dm
+dm
+dm
+dm
+dm
+dm
+dm
+dm
+dm
+time dm
+rh dolphin
+rt gerbil
@@ -0,0 +1,116 @@
+# Test of sort variants
+option fail 0
+option malloc 0
+option threads 4
+new
+ih RAND 50000
+it a
+ih zzzzzzzzzz
+sort
+rh a
+rt zzzzzzzzzz
+reverse
+sort
+free
+new
+ih gerbil 20000
+ih bear 20000
+it dolphin 20000
+sort
+rh bear
+rt gerbil
+option threads 1
+free
+new
+it abcdefghij
+it abcdefgh
+ih abcdefghia 3
+it abcdefg
+it b
+ih abcdefghij
+it abcdefghi
+sort prefix
+rh abcdefg
+rh abcdefgh
+rh abcdefghi
+rh abcdefghia
+rh abcdefghia
+rh abcdefghia
+rh abcdefghij
+rh abcdefghij
+rh b
+ih RAND 50000
+it a
+ih zzzzzzzzzz
+sort prefix
+rh a
+rt zzzzzzzzzz
+free
+new
+it abcdefghij
+it abcdefgh
+ih abcdefghia 3
+it abcdefg
+it b
+ih abcdefghij
+it abcdefghi
+ih abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz 100
+ih abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyy 100
+sort radix
+dedup
+rh abcdefg
+rh abcdefgh
+rh abcdefghi
+rh b
+ih RAND 50000
+it a
+ih zzzzzzzzzz
+sort radix
+rh a
+rt zzzzzzzzzz
+free
+new
+it a 50
+it ab 20
+sort radix
+rh a
+rt ab
+ih ab 100
+it a 30
+it abc 10
+sort radix
+rh a
+rt abc
+free
+new
+it abcdefghij
+it abcdefgh
+ih abcdefghia 3
+it abcdefg
+it b
+ih abcdefghij
+it abcdefghi
+sort natural
+rh abcdefg
+rh abcdefgh
+rh abcdefghi
+rh abcdefghia
+rh abcdefghia
+rh abcdefghia
+rh abcdefghij
+rh abcdefghij
+rh b
+ih RAND 50000
+it a
+ih zzzzzzzzzz
+sort natural
+rh a
+rt zzzzzzzzzz
+sort natural
+reverse
+sort natural
+ih zzzzzzzzzz 2000
+it a 2000
+sort natural
+rh a
+rt zzzzzzzzzz
@@ -0,0 +1,32 @@
+# Test of delete_dup on unsorted queue
+option fail 0
+option malloc 0
+new
+it gerbil
+it bear
+it dolphin
+it bear
+it meerkat
+it gerbil
+it vulture
+it bear
+dedup hash
+rh dolphin
+rh meerkat
+rh vulture
+ih squirrel
+dedup hash
+rh squirrel
+dedup hash
+ih RAND 50000
+it gerbil 5
+ih gerbil
+dedup hash
+sort
+dedup
+free
+new
+ih dolphin 1000
+it bear
+dedup hash
+rh bear
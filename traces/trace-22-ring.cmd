@@ -0,0 +1,41 @@
+# Test of the ring buffer engine, including operations falling back to the list
+option fail 0
+option malloc 0
+new ring
+ih dolphin
+ih bear
+it gerbil
+reverse
+ih meerkat
+it vulture
+rh meerkat
+rt vulture
+rh gerbil
+reverse
+it squirrel 40
+ih lion 20
+swap
+dm
+sort
+dedup
+rh bear
+rh dolphin
+reverse
+it tiger
+ih lion
+rt tiger
+rh lion
+free
+option fail 30
+new ring
+option malloc 25
+ih jaguar 10
+it RAND 10
+option malloc 0
+free
+new ring
+option simulation 1
+rh
+rt
+option simulation 0
+free
@@ -0,0 +1,10 @@
+# Test performance of freeing a queue of 500K separately allocated elements
+# with every free validated by the harness
+option fail 0
+option malloc 0
+new
+ih kestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrel 250000
+it kestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrel 250000
+rh kestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrel
+rt kestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrelkestrel
+free
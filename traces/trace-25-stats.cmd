@@ -0,0 +1,23 @@
+# Test of latency histograms of queue API calls
+option fail 0
+option malloc 0
+option instrument 1
+new
+ih dolphin 1000
+it RAND 1000
+rh dolphin
+rt
+size 100
+reverse
+sort
+dm
+swap
+dedup
+stats
+stats reset
+new ring
+it gerbil 1000
+rh gerbil
+stats
+free
+option instrument 0
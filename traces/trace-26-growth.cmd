@@ -0,0 +1,7 @@
+# Test if q_sort grows as O(N log N), and q_reverse, q_swap and q_delete_dup as O(N)
+option simulation 1
+sort
+reverse
+swap
+dedup
+option simulation 0
@@ -0,0 +1,22 @@
+# Test of allocations per call of queue API functions
+option fail 0
+option malloc 0
+option memstat 1
+new
+ih dolphin 1000
+it RAND 1000
+rh dolphin
+rt
+reverse
+sort
+dm
+swap
+dedup
+memstat
+memstat reset
+option memstat 0
+new ring
+it gerbil 1000
+rh gerbil
+memstat
+free
@@ -0,0 +1,9 @@
+# Test of writing every element of a large queue to a file
+option fail 0
+option malloc 0
+new
+ih RAND 1000000
+show /dev/null
+reverse
+show /dev/null
+free
@@ -0,0 +1,20 @@
+# Test of reproducible shuffle and its performance on a large queue
+option fail 0
+option malloc 0
+new
+it a
+it b
+it c
+it d
+it e
+option seed 7
+shuffle
+rh b
+rh d
+rh a
+rh c
+rh e
+ih RAND 500000
+shuffle
+sort
+free
@@ -0,0 +1,57 @@
+# Test of merging sorted queues of both engines, and its performance
+option fail 0
+option malloc 0
+new
+it b
+it d
+it gerbil
+switch vulture
+new ring
+it a
+it d
+it fish
+switch empty
+new
+switch 0
+merge
+rh a
+rh b
+rh d
+rh d
+rh fish
+rh gerbil
+switch vulture
+size
+free
+switch empty
+free
+switch 0
+it RAND 100000
+sort
+switch vulture
+new
+ih RAND 100000
+sort
+switch 0
+merge
+size
+free
+switch vulture
+free
+switch 0
+new
+it a
+it b
+it c
+dm
+switch vulture
+new
+it b
+switch 0
+merge
+rh a
+rh b
+rh c
+free
+switch vulture
+free
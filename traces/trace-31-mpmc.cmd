@@ -0,0 +1,9 @@
+# Test of passing elements between threads through the concurrent queue
+option fail 0
+option malloc 0
+bench mpmc 1 1 1
+bench mpmc 4 2 20000
+bench mpmc 2 5 20000
+new
+it a
+free
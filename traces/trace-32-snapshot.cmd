@@ -0,0 +1,27 @@
+# Test of saving a queue to a snapshot and loading it back
+option fail 0
+option malloc 0
+new
+ih gerbil
+ih dolphin
+it bear
+save /tmp/qtest.snapshot
+free
+new ring
+it vulture
+load /tmp/qtest.snapshot
+rh vulture
+rh dolphin
+rh gerbil
+rh bear
+free
+new
+it RAND 200000
+save /tmp/qtest.snapshot
+free
+new
+load /tmp/qtest.snapshot
+load /tmp/qtest.snapshot
+size
+sort
+free
@@ -0,0 +1,61 @@
+# Test of q_reverseK, q_reverse and q_swap on both engines
+option fail 0
+option malloc 0
+new
+it a
+it b
+it c
+it d
+it e
+it f
+it g
+it h
+reverseK 3
+rh c
+rh b
+rh a
+rh f
+rh e
+rh d
+rh g
+rh h
+reverseK 2
+it a
+reverseK 1
+reverseK 2
+rh a
+it a
+it b
+it c
+it d
+it e
+swap
+reverse
+rh e
+rh c
+rh d
+rh a
+rh b
+free
+new ring
+ih c
+ih b
+ih a
+it d
+it e
+reverse
+reverseK 2
+rh d
+rh e
+rh b
+rh c
+rh a
+free
+new
+it RAND 100000
+reverseK 1000
+reverseK 1000
+size
+reverse
+swap
+free
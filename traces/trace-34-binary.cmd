@@ -0,0 +1,278 @@
+# Test of compiling a trace and replaying it, which must print the same
+# as running the text. Over 128 distinct strings and a line repeated over
+# 127 times need varints of more than one byte
+option fail 0
+option malloc 0
+new
+
+ih   spaced    2
+it	tab
+ih spaced 2
+rh  spaced
+rh spaced
+rh spaced
+rh   spaced
+rt tab
+ih w000
+ih w001
+ih w002
+ih w003
+ih w004
+ih w005
+ih w006
+ih w007
+ih w008
+ih w009
+ih w010
+ih w011
+ih w012
+ih w013
+ih w014
+ih w015
+ih w016
+ih w017
+ih w018
+ih w019
+ih w020
+ih w021
+ih w022
+ih w023
+ih w024
+ih w025
+ih w026
+ih w027
+ih w028
+ih w029
+ih w030
+ih w031
+ih w032
+ih w033
+ih w034
+ih w035
+ih w036
+ih w037
+ih w038
+ih w039
+ih w040
+ih w041
+ih w042
+ih w043
+ih w044
+ih w045
+ih w046
+ih w047
+ih w048
+ih w049
+ih w050
+ih w051
+ih w052
+ih w053
+ih w054
+ih w055
+ih w056
+ih w057
+ih w058
+ih w059
+ih w060
+ih w061
+ih w062
+ih w063
+ih w064
+ih w065
+ih w066
+ih w067
+ih w068
+ih w069
+ih w070
+ih w071
+ih w072
+ih w073
+ih w074
+ih w075
+ih w076
+ih w077
+ih w078
+ih w079
+ih w080
+ih w081
+ih w082
+ih w083
+ih w084
+ih w085
+ih w086
+ih w087
+ih w088
+ih w089
+ih w090
+ih w091
+ih w092
+ih w093
+ih w094
+ih w095
+ih w096
+ih w097
+ih w098
+ih w099
+ih w100
+ih w101
+ih w102
+ih w103
+ih w104
+ih w105
+ih w106
+ih w107
+ih w108
+ih w109
+ih w110
+ih w111
+ih w112
+ih w113
+ih w114
+ih w115
+ih w116
+ih w117
+ih w118
+ih w119
+ih w120
+ih w121
+ih w122
+ih w123
+ih w124
+ih w125
+ih w126
+ih w127
+ih w128
+ih w129
+size
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+rh
+size
+free